@@ -0,0 +1,421 @@
+// Microbenchmarks for probes, config loading, formatting and rendering.
+//
+//   mfetch-bench [--filter SUBSTR] [--json OUT] [--compare BASELINE]
+//
+// Run from the repository root (configs are read from data/). The topology and
+// NUMA probes also run against synthetic 16- and 512-cpu sysroots under /tmp.
+// Reports ns/op, allocations/op and syscalls/op; syscalls are counted in a
+// ptraced child so the timed loop itself runs untraced.
+
+#include "../source/inc/ascii.hpp"
+#include "../source/inc/config.hpp"
+#include "../source/inc/format.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// -- allocation counting --
+
+// gcc flags free() in a replaced operator delete as mismatched; it pairs with the malloc below
+#if defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<long> g_allocs{0};
+
+void *operator new(std::size_t n)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    using namespace renderer_ns;
+    using bench_clock_t = std::chrono::steady_clock;
+
+    struct bench_t
+    {
+            std::string name;
+            std::function<void()> fn;
+            long max_iters; // slow probes spawn processes, cap them
+    };
+
+    struct result_t
+    {
+            std::string name;
+            double ns_per_op = 0;
+            double allocs_per_op = 0;
+            double syscalls_per_op = -1; // -1 = could not trace
+            long iters = 0;
+    };
+
+    // keeps the optimiser from dropping results
+    template <typename T>
+    void keep_fn(T &&v)
+    {
+        asm volatile("" : : "g"(&v) : "memory");
+    }
+
+    result_t run_fn(const bench_t &b)
+    {
+        result_t r;
+        r.name = b.name;
+
+        b.fn(); // warm up: page cache, lazy singletons
+
+        const auto budget = std::chrono::milliseconds(200);
+        long allocs0 = g_allocs.load();
+        auto t0 = bench_clock_t::now();
+        long n = 0;
+        do
+        {
+            b.fn();
+            ++n;
+        } while (n < b.max_iters && bench_clock_t::now() - t0 < budget);
+        auto t1 = bench_clock_t::now();
+        long allocs1 = g_allocs.load();
+
+        r.iters = n;
+        r.ns_per_op = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+        r.allocs_per_op = double(allocs1 - allocs0) / n;
+
+        // syscalls: same body in a traced child, minus the cost of an empty child
+        static long empty = bench_ns::trace_child_fn([] {}).syscalls;
+        long k = std::min(n, 16L);
+        auto c = bench_ns::trace_child_fn([&]
+                                          {
+                                              for (long i = 0; i < k; ++i)
+                                                  b.fn(); });
+        if (c.syscalls > 0)
+            r.syscalls_per_op = double(std::max(0L, c.syscalls - empty)) / k;
+        return r;
+    }
+
+    // Baselines are written one object per line so they can be read back without a JSON library
+    void save_fn(const std::vector<result_t> &res, const std::string &path)
+    {
+        std::ofstream f(path);
+        f << "[\n";
+        for (size_t i = 0; i < res.size(); ++i)
+        {
+            const auto &r = res[i];
+            char line[512];
+            std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"syscalls_per_op\":%.2f,\"iters\":%ld}%s\n",
+                          r.name.c_str(), r.ns_per_op, r.allocs_per_op, r.syscalls_per_op, r.iters, i + 1 < res.size() ? "," : "");
+            f << line;
+        }
+        f << "]\n";
+    }
+
+    std::map<std::string, result_t> load_fn(const std::string &path)
+    {
+        std::map<std::string, result_t> out;
+        std::ifstream f(path);
+        std::string line;
+        while (std::getline(f, line))
+        {
+            char name[256];
+            result_t r;
+            if (std::sscanf(line.c_str(), "{\"name\":\"%255[^\"]\",\"ns_per_op\":%lf,\"allocs_per_op\":%lf,\"syscalls_per_op\":%lf", name, &r.ns_per_op, &r.allocs_per_op, &r.syscalls_per_op) == 4)
+            {
+                r.name = name;
+                out[r.name] = r;
+            }
+        }
+        return out;
+    }
+
+    // A synthetic /sys for a machine of the given size, so the topology and NUMA
+    // probes can be timed at 16 and 512 cpus on any box: 2 sockets, SMT 2 with
+    // Linux's numbering (thread t of core c is cpu c + t * cores), cpus split
+    // evenly over nodes. Removed when the last bench using it is gone.
+    struct fixture_t
+    {
+            source_ns::source_t source;
+            sysinfo_ns::sysinfo_t sys{source};
+
+            explicit fixture_t(std::string root) : source(std::move(root))
+            {
+            }
+
+            ~fixture_t()
+            {
+                std::error_code ec;
+                std::filesystem::remove_all(source.root_fn(), ec);
+            }
+    };
+
+    std::shared_ptr<fixture_t> fixture_fn(long cpus, long nodes)
+    {
+        char tmpl[] = "/tmp/mfetch-bench-XXXXXX";
+        if (!::mkdtemp(tmpl))
+            return nullptr;
+        std::string root = tmpl;
+        auto put = [&](const std::string &path, const std::string &text)
+        {
+            std::filesystem::create_directories(std::filesystem::path(root + path).parent_path());
+            std::ofstream(root + path) << text << "\n";
+        };
+        auto range = [](long a, long b)
+        { return a == b ? std::to_string(a) : std::to_string(a) + "-" + std::to_string(b); };
+
+        const std::string cpu = "/sys/devices/system/cpu";
+        long cores = cpus / 2;
+        put(cpu + "/online", range(0, cpus - 1));
+        put(cpu + "/possible", range(0, cpus - 1));
+        put(cpu + "/isolated", "");
+        put(cpu + "/smt/control", "on");
+        for (long c = 0; c < cpus; ++c)
+        {
+            long core = c % cores;
+            std::string dir = cpu + "/cpu" + std::to_string(c);
+            std::string siblings = std::to_string(core) + "," + std::to_string(core + cores);
+            put(dir + "/topology/physical_package_id", std::to_string(core * 2 / cores));
+            put(dir + "/topology/core_id", std::to_string(core));
+            put(dir + "/topology/core_cpus_list", siblings);
+            put(dir + "/topology/thread_siblings_list", siblings);
+            put(dir + "/online", "1");
+        }
+        const char *caches[][4] = {{"1", "Data", "48K", "pair"}, {"1", "Instruction", "32K", "pair"}, {"2", "Unified", "2048K", "pair"}, {"3", "Unified", "262144K", "socket"}};
+        for (size_t i = 0; i < 4; ++i)
+        {
+            std::string dir = cpu + "/cpu0/cache/index" + std::to_string(i);
+            put(dir + "/level", caches[i][0]);
+            put(dir + "/type", caches[i][1]);
+            put(dir + "/size", caches[i][2]);
+            put(dir + "/shared_cpu_list", std::strcmp(caches[i][3], "pair") == 0 ? "0," + std::to_string(cores) : range(0, cores / 2 - 1) + "," + range(cores, cores + cores / 2 - 1));
+        }
+
+        const std::string node = "/sys/devices/system/node";
+        long per = cpus / nodes;
+        for (long n = 0; n < nodes; ++n)
+        {
+            std::string dir = node + "/node" + std::to_string(n);
+            std::string id = "Node " + std::to_string(n) + " ";
+            put(dir + "/cpulist", range(n * per, (n + 1) * per - 1));
+            put(dir + "/meminfo", id + "MemTotal:       65536000 kB\n" + id + "MemFree:        32768000 kB\n" + id + "MemUsed:        32768000 kB");
+        }
+        return std::make_shared<fixture_t>(root);
+    }
+
+    std::vector<bench_t> benches_fn()
+    {
+        auto &sys = sysinfo_ns::sysinfo_t::instance_fn();
+        std::vector<bench_t> b;
+
+        // probes
+        b.push_back({"probe/hostname", [&]
+                     { keep_fn(sys.get_hostname_fn()); },
+                     200});
+        b.push_back({"probe/username", [&]
+                     { keep_fn(sys.get_username_fn()); },
+                     200});
+        b.push_back({"probe/kernel", [&]
+                     { keep_fn(sys.get_kernel_fn()); },
+                     200});
+        b.push_back({"probe/kernel_name", [&]
+                     { keep_fn(sys.get_kernel_name_fn()); },
+                     100000});
+        b.push_back({"probe/os", [&]
+                     { keep_fn(sys.get_os_fn()); },
+                     100000});
+        b.push_back({"probe/cpu", [&]
+                     { keep_fn(sys.get_cpu_fn()); },
+                     200});
+        b.push_back({"probe/gpus", [&]
+                     { keep_fn(sys.get_gpus_fn()); },
+                     100});
+        b.push_back({"probe/mem", [&]
+                     { keep_fn(sys.get_mem_fn()); },
+                     100000});
+        b.push_back({"probe/wm", [&]
+                     { keep_fn(sys.get_wm_fn()); },
+                     1000000});
+        b.push_back({"probe/de", [&]
+                     { keep_fn(sys.get_de_fn()); },
+                     1000000});
+        b.push_back({"probe/shell", [&]
+                     { keep_fn(sys.get_shell_fn()); },
+                     200});
+        b.push_back({"probe/term", [&]
+                     { keep_fn(sys.get_term_fn()); },
+                     100});
+        b.push_back({"probe/pkgs", [&]
+                     { keep_fn(sys.get_pkgs_fn()); },
+                     10});
+        b.push_back({"probe/proc", [&]
+                     { keep_fn(sys.get_proc_count_fn()); },
+                     100});
+        b.push_back({"probe/mounts", [&]
+                     { keep_fn(sys.get_mounts_fn()); },
+                     100000});
+        b.push_back({"probe/load", [&]
+                     { keep_fn(sys.get_load_fn()); },
+                     100000});
+        b.push_back({"probe/uptime", [&]
+                     { keep_fn(sys.get_uptime_fn()); },
+                     100000});
+        b.push_back({"probe/temps", [&]
+                     { keep_fn(sys.get_temps_fn()); },
+                     100000});
+        b.push_back({"probe/topology", [&]
+                     { keep_fn(sys.get_topology_fn()); },
+                     100000});
+        b.push_back({"probe/numa", [&]
+                     { keep_fn(sys.get_numa_fn()); },
+                     100000});
+
+        // the same two on synthetic machines. Topology reads once per core, so 512 cpus
+        // should stay within ~32x of 16 (256 vs 8 cores) in time and syscalls;
+        // per-thread reads would show as 64x. NUMA follows the node count.
+        for (long cpus : {16L, 512L})
+        {
+            auto fx = fixture_fn(cpus, cpus == 16 ? 2 : 8);
+            if (!fx)
+                continue;
+            std::string n = std::to_string(cpus);
+            b.push_back({"probe/topology@" + n + "cpu", [fx]
+                         { keep_fn(fx->sys.get_topology_fn()); },
+                         100000});
+            b.push_back({"probe/numa@" + n + "cpu", [fx]
+                         { keep_fn(fx->sys.get_numa_fn()); },
+                         100000});
+        }
+
+        // config loading
+        for (const char *cfg : {"data/mfetch.conf", "data/mfetch.conf.example", "data/mfetch.toml"})
+        {
+            std::string path = cfg;
+            b.push_back({std::string("config/") + (std::strrchr(cfg, '/') + 1), [path]
+                         { keep_fn(config_ns::load_config_fn(path)); },
+                         100000});
+        }
+
+        // styling and formatting
+        b.push_back({"util/color_fn", []
+                     { keep_fn(util_ns::color_fn("6.18.44", "italic #aaaec1")); },
+                     10000000});
+
+        b.push_back({"numfmt/append_bytes_fn", []
+                     {
+                         static std::string out;
+                         static const numfmt_ns::unit_t u = numfmt_ns::parse_unit_fn("auto");
+                         out.clear();
+                         numfmt_ns::append_bytes_fn(out, 6123456, u);
+                         keep_fn(out); },
+                     10000000});
+
+        static const std::string styled = "\033[1;38;2;203;206;219mkrnl\033[0m - \033[3;38;2;170;174;193m6.18.44 ⠀⠀⣴⠟⠁\033[0m";
+        b.push_back({"layout/visible_len_fn", []
+                     { keep_fn(layout_ns::visible_len_fn(styled)); },
+                     10000000});
+
+        static const char *tmpl = "   ├─ ram: [used -round=1 -color #e6ccff] [unit] / [all -round=1 -color #f2e6ff] [unit -lower]";
+        b.push_back({"format/compile", []
+                     { keep_fn(format_ns::compile_fn(tmpl, "ram")); },
+                     10000000});
+
+        // resolve: compiled template against a warm fact store
+        static facts_ns::store_t facts(sys);
+        static format_ns::unit_t unit;
+        static format_ns::program_t prog = format_ns::compile_fn(tmpl, "ram");
+        b.push_back({"format/resolve", []
+                     {
+                         static std::string out;
+                         out.clear();
+                         format_ns::run_ctx_t ctx{facts, unit};
+                         format_ns::run_fn(prog, ctx, out);
+                         keep_fn(out); },
+                     10000000});
+
+        // full frame into a null sink; probes are cached after the warm-up run
+        for (const char *cfg : {"data/mfetch.conf", "data/mfetch.toml"})
+        {
+            auto engine = std::make_shared<engine_t>(config_ns::load_config_fn(cfg));
+            b.push_back({std::string("render/") + (std::strrchr(cfg, '/') + 1), [engine]
+                         {
+                             std::string out;
+                             engine->render_to_fn(out);
+                             keep_fn(out); },
+                         1000000});
+        }
+
+        return b;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string filter, json_out, compare;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (a == "--json" && i + 1 < argc)
+            json_out = argv[++i];
+        else if (a == "--compare" && i + 1 < argc)
+            compare = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: mfetch-bench [--filter SUBSTR] [--json OUT] [--compare BASELINE]\n");
+            return 2;
+        }
+    }
+
+    std::map<std::string, result_t> base;
+    if (!compare.empty())
+        base = load_fn(compare);
+
+    std::printf("%-28s %14s %12s %12s %9s\n", "benchmark", "ns/op", "allocs/op", "syscalls/op", base.empty() ? "" : "vs base");
+
+    std::vector<result_t> results;
+    for (const auto &b : benches_fn())
+    {
+        if (!filter.empty() && b.name.find(filter) == std::string::npos)
+            continue;
+        result_t r = run_fn(b);
+        results.push_back(r);
+
+        char sys_col[32] = "n/a";
+        if (r.syscalls_per_op >= 0)
+            std::snprintf(sys_col, sizeof(sys_col), "%.1f", r.syscalls_per_op);
+
+        char delta[32] = "";
+        auto it = base.find(r.name);
+        if (it != base.end() && it->second.ns_per_op > 0)
+            std::snprintf(delta, sizeof(delta), "%+.1f%%", (r.ns_per_op / it->second.ns_per_op - 1) * 100);
+
+        std::printf("%-28s %14.1f %12.2f %12s %9s\n", r.name.c_str(), r.ns_per_op, r.allocs_per_op, sys_col, delta);
+        std::fflush(stdout);
+    }
+
+    if (!json_out.empty())
+        save_fn(results, json_out);
+    return 0;
+}
@@ -0,0 +1,309 @@
+// End-to-end startup budget harness.
+//
+//   mfetch-startup --bin PATH [--runs N] [--budget FILE] [--baseline REPORT] [--json OUT] [CONFIG...]
+//
+// Runs the built binary against each config (default: the ones in data/), N times untraced
+// for wall time and peak RSS, then once under ptrace for syscall and process-spawn counts.
+// Prints a JSON report and exits 1 if any config breaks the budget or spawns more
+// processes than in the baseline report.
+//
+// Budget file, same key = value style as the mfetch config:
+//
+//   [default]
+//   p50_ms = 40
+//   p99_ms = 80
+//   max_spawns = 16
+//   max_syscalls = 6000
+//   max_rss_kb = 16384
+//
+//   [mfetch.toml]       per-config overrides, by file name
+//   max_spawns = 20
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct budget_t
+    {
+            double p50_ms = -1;
+            double p99_ms = -1;
+            long max_spawns = -1;
+            long max_syscalls = -1;
+            long max_rss_kb = -1;
+    };
+
+    struct report_t
+    {
+            std::string config;
+            double p50_ms = 0;
+            double p99_ms = 0;
+            double min_ms = 0;
+            long spawns = 0;
+            long execs = 0;
+            long syscalls = 0;
+            long rss_kb = 0;
+            int exit_status = 0;
+            std::vector<std::string> violations;
+    };
+
+    std::string base_name_fn(const std::string &p)
+    {
+        auto s = p.find_last_of('/');
+        return s == std::string::npos ? p : p.substr(s + 1);
+    }
+
+    std::string trim_fn(const std::string &s)
+    {
+        auto a = s.find_first_not_of(" \t\r\n");
+        if (a == std::string::npos)
+            return "";
+        return s.substr(a, s.find_last_not_of(" \t\r\n") - a + 1);
+    }
+
+    std::map<std::string, budget_t> load_budget_fn(const std::string &path)
+    {
+        std::map<std::string, budget_t> out;
+        std::ifstream f(path);
+        if (!f)
+        {
+            std::fprintf(stderr, "mfetch-startup: cannot read budget '%s'\n", path.c_str());
+            std::exit(2);
+        }
+
+        std::string section = "default";
+        std::string line;
+        while (std::getline(f, line))
+        {
+            std::string tr = trim_fn(line);
+            if (tr.empty() || tr[0] == '#')
+                continue;
+            if (tr.front() == '[' && tr.back() == ']')
+            {
+                section = trim_fn(tr.substr(1, tr.size() - 2));
+                // sections start from the defaults read so far
+                if (!out.count(section))
+                    out[section] = out["default"];
+                continue;
+            }
+            auto eq = tr.find('=');
+            if (eq == std::string::npos)
+                continue;
+            std::string key = trim_fn(tr.substr(0, eq));
+            double val = std::atof(trim_fn(tr.substr(eq + 1)).c_str());
+
+            auto &b = out[section];
+            if (key == "p50_ms")
+                b.p50_ms = val;
+            else if (key == "p99_ms")
+                b.p99_ms = val;
+            else if (key == "max_spawns")
+                b.max_spawns = (long)val;
+            else if (key == "max_syscalls")
+                b.max_syscalls = (long)val;
+            else if (key == "max_rss_kb")
+                b.max_rss_kb = (long)val;
+            else
+                std::fprintf(stderr, "mfetch-startup: unknown budget key '%s'\n", key.c_str());
+        }
+        return out;
+    }
+
+    // Reads spawn counts back from a previous report (one config per line)
+    std::map<std::string, long> load_baseline_fn(const std::string &path)
+    {
+        std::map<std::string, long> out;
+        std::ifstream f(path);
+        std::string line;
+        while (std::getline(f, line))
+        {
+            auto c = line.find("\"config\":\"");
+            auto s = line.find("\"spawns\":");
+            if (c == std::string::npos || s == std::string::npos)
+                continue;
+            c += 10;
+            out[line.substr(c, line.find('"', c) - c)] = std::atol(line.c_str() + s + 9);
+        }
+        return out;
+    }
+
+    double percentile_fn(std::vector<double> v, double p)
+    {
+        if (v.empty())
+            return 0;
+        std::sort(v.begin(), v.end());
+        size_t i = (size_t)std::min<double>(v.size() - 1, p * (v.size() - 1) + 0.5);
+        return v[i];
+    }
+
+    report_t measure_fn(const std::string &bin, const std::string &config, int runs)
+    {
+        report_t r;
+        r.config = config;
+
+        std::vector<std::string> args = {bin, "--config", config};
+        std::vector<char *> argv;
+        for (auto &a : args)
+            argv.push_back(a.data());
+        argv.push_back(nullptr);
+
+        // untraced: wall time and peak RSS
+        std::vector<double> ms;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                int devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+                execv(argv[0], argv.data());
+                _exit(127);
+            }
+            int status;
+            struct rusage ru;
+            wait4(pid, &status, 0, &ru);
+            auto t1 = std::chrono::steady_clock::now();
+
+            ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+            r.rss_kb = std::max(r.rss_kb, (long)ru.ru_maxrss);
+            r.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        r.p50_ms = percentile_fn(ms, 0.50);
+        r.p99_ms = percentile_fn(ms, 0.99);
+        r.min_ms = percentile_fn(ms, 0.0);
+
+        // traced: syscalls and spawns (the harness's own exec is not counted)
+        auto c = bench_ns::trace_exec_fn(argv.data());
+        r.syscalls = c.syscalls;
+        r.spawns = c.spawns;
+        r.execs = std::max(0L, c.execs - 1);
+        return r;
+    }
+
+    void check_fn(report_t &r, const budget_t &b, const std::map<std::string, long> &baseline)
+    {
+        char msg[160];
+        auto fail = [&](const char *what, double got, double limit)
+        {
+            std::snprintf(msg, sizeof(msg), "%s %.2f > %.2f", what, got, limit);
+            r.violations.push_back(msg);
+        };
+
+        if (r.exit_status != 0)
+        {
+            std::snprintf(msg, sizeof(msg), "exit status %d", r.exit_status);
+            r.violations.push_back(msg);
+        }
+        if (b.p50_ms >= 0 && r.p50_ms > b.p50_ms)
+            fail("p50_ms", r.p50_ms, b.p50_ms);
+        if (b.p99_ms >= 0 && r.p99_ms > b.p99_ms)
+            fail("p99_ms", r.p99_ms, b.p99_ms);
+        if (b.max_spawns >= 0 && r.spawns > b.max_spawns)
+            fail("spawns", (double)r.spawns, (double)b.max_spawns);
+        if (b.max_syscalls >= 0 && r.syscalls > b.max_syscalls)
+            fail("syscalls", (double)r.syscalls, (double)b.max_syscalls);
+        if (b.max_rss_kb >= 0 && r.rss_kb > b.max_rss_kb)
+            fail("rss_kb", (double)r.rss_kb, (double)b.max_rss_kb);
+
+        auto it = baseline.find(r.config);
+        if (it != baseline.end() && r.spawns > it->second)
+            fail("spawns vs baseline", (double)r.spawns, (double)it->second);
+    }
+
+    std::string report_json_fn(const std::vector<report_t> &reports, int runs, bool ok)
+    {
+        std::string out = "{\"runs\":" + std::to_string(runs) + ",\"ok\":" + (ok ? "true" : "false") + ",\"configs\":[\n";
+        char line[512];
+        for (size_t i = 0; i < reports.size(); ++i)
+        {
+            const auto &r = reports[i];
+            std::snprintf(line, sizeof(line), "{\"config\":\"%s\",\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"min_ms\":%.3f,\"spawns\":%ld,\"execs\":%ld,\"syscalls\":%ld,\"peak_rss_kb\":%ld,\"violations\":[",
+                          r.config.c_str(), r.p50_ms, r.p99_ms, r.min_ms, r.spawns, r.execs, r.syscalls, r.rss_kb);
+            out += line;
+            for (size_t v = 0; v < r.violations.size(); ++v)
+                out += (v ? ",\"" : "\"") + r.violations[v] + "\"";
+            out += (i + 1 < reports.size()) ? "]},\n" : "]}\n";
+        }
+        out += "]}\n";
+        return out;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string bin, budget_path, baseline_path, json_out;
+    int runs = 50;
+    std::vector<std::string> configs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--bin" && i + 1 < argc)
+            bin = argv[++i];
+        else if (a == "--runs" && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--budget" && i + 1 < argc)
+            budget_path = argv[++i];
+        else if (a == "--baseline" && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (a == "--json" && i + 1 < argc)
+            json_out = argv[++i];
+        else if (a[0] != '-')
+            configs.push_back(a);
+        else
+        {
+            std::fprintf(stderr, "usage: mfetch-startup --bin PATH [--runs N] [--budget FILE] [--baseline REPORT] [--json OUT] [CONFIG...]\n");
+            return 2;
+        }
+    }
+    if (bin.empty())
+    {
+        std::fprintf(stderr, "mfetch-startup: --bin is required\n");
+        return 2;
+    }
+    if (configs.empty())
+        configs = {"data/mfetch.conf", "data/mfetch.conf.example", "data/mfetch.toml"};
+
+    std::map<std::string, budget_t> budgets;
+    if (!budget_path.empty())
+        budgets = load_budget_fn(budget_path);
+    std::map<std::string, long> baseline;
+    if (!baseline_path.empty())
+        baseline = load_baseline_fn(baseline_path);
+
+    std::vector<report_t> reports;
+    bool ok = true;
+    for (const auto &cfg : configs)
+    {
+        report_t r = measure_fn(bin, cfg, runs);
+        auto it = budgets.find(base_name_fn(cfg));
+        check_fn(r, it != budgets.end() ? it->second : budgets["default"], baseline);
+        ok = ok && r.violations.empty();
+
+        std::fprintf(stderr, "%-28s p50 %8.2f ms  p99 %8.2f ms  spawns %3ld  syscalls %6ld  rss %6ld kB  %s\n",
+                     base_name_fn(cfg).c_str(), r.p50_ms, r.p99_ms, r.spawns, r.syscalls, r.rss_kb, r.violations.empty() ? "ok" : "OVER BUDGET");
+        for (const auto &v : r.violations)
+            std::fprintf(stderr, "    %s\n", v.c_str());
+        reports.push_back(std::move(r));
+    }
+
+    std::string json = report_json_fn(reports, runs, ok);
+    if (json_out.empty())
+        std::fputs(json.c_str(), stdout);
+    else
+    {
+        std::ofstream f(json_out);
+        f << json;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdio>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// ptrace-based counters. Needs no perf_event_paranoid tweaks and no tracefs:
+// the parent traces its own child, which Yama allows by default.
+namespace bench_ns
+{
+    struct trace_counts_t
+    {
+            long syscalls = 0;
+            long spawns = 0;  // fork / vfork / non-thread clone
+            long threads = 0; // clone(CLONE_THREAD)
+            long execs = 0;
+            long max_rss_kb = 0;
+            int exit_status = 0;
+    };
+
+    // Traces pid (stopped in PTRACE_TRACEME + SIGSTOP) and all its descendants until it exits
+    inline trace_counts_t trace_pid_fn(pid_t pid)
+    {
+        trace_counts_t c;
+        int status;
+        if (waitpid(pid, &status, 0) < 0)
+            return c;
+
+        ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+        ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+        for (;;)
+        {
+            struct rusage ru;
+            pid_t p = wait4(-1, &status, __WALL, &ru);
+            if (p < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            if (WIFEXITED(status) || WIFSIGNALED(status))
+            {
+                if (p == pid)
+                {
+                    c.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                    c.max_rss_kb = ru.ru_maxrss;
+                    // descendants may outlive the root; keep reaping until none are left
+                }
+                continue;
+            }
+            if (!WIFSTOPPED(status))
+                continue;
+
+            int sig = WSTOPSIG(status);
+            int event = status >> 16;
+            int inject = 0;
+
+            if (sig == (SIGTRAP | 0x80))
+            {
+                // enter and exit stops look the same, ask the kernel which one this is
+                struct __ptrace_syscall_info info;
+                if (ptrace(PTRACE_GET_SYSCALL_INFO, p, sizeof(info), &info) > 0 && info.op == PTRACE_SYSCALL_INFO_ENTRY)
+                    c.syscalls++;
+            }
+            else if (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK)
+                c.spawns++;
+            else if (event == PTRACE_EVENT_CLONE)
+                c.threads++;
+            else if (event == PTRACE_EVENT_EXEC)
+                c.execs++;
+            else if (event == PTRACE_EVENT_STOP || sig == SIGSTOP)
+                inject = 0; // auto-attached children start stopped
+            else if (sig != SIGTRAP)
+                inject = sig;
+
+            ptrace(PTRACE_SYSCALL, p, 0, inject);
+        }
+        return c;
+    }
+
+    // Runs fn() in a traced child. Counts include the child's own _exit.
+    template <typename Fn>
+    inline trace_counts_t trace_child_fn(Fn fn)
+    {
+        std::fflush(nullptr);
+        pid_t pid = fork();
+        if (pid < 0)
+            return {};
+        if (pid == 0)
+        {
+            ptrace(PTRACE_TRACEME, 0, 0, 0);
+            raise(SIGSTOP);
+            fn();
+            _exit(0);
+        }
+        return trace_pid_fn(pid);
+    }
+
+    // Runs argv in a traced child with stdout and stderr discarded
+    inline trace_counts_t trace_exec_fn(char *const argv[])
+    {
+        return trace_child_fn([&]
+                              {
+                                  int devnull = open("/dev/null", O_WRONLY);
+                                  dup2(devnull, STDOUT_FILENO);
+                                  dup2(devnull, STDERR_FILENO);
+                                  execv(argv[0], argv);
+                                  _exit(127); });
+    }
+} // namespace bench_ns
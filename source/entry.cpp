@@ -5,11 +5,108 @@
 #include <filesystem>
 
 #include "inc/args.hpp"
+#include "inc/output.hpp"
+#include "inc/prometheus.hpp"
+#include "inc/containers.hpp"
+#include "inc/factcache.hpp"
+#include <thread>
 
 using namespace renderer_ns;
 using namespace config_ns;
 using namespace args_ns;
 
+// Dumps --timings / --trace output however main_fn exits
+struct timing_guard_t
+{
+        const args_t &args;
+
+        ~timing_guard_t()
+        {
+            if (!timing_ns::enabled_fn())
+                return;
+            auto events = timing_ns::take_fn();
+            if (args.timings)
+                timing_ns::report_fn(events, std::cerr);
+            if (!args.trace_path.empty())
+            {
+                try
+                {
+                    util_ns::write_file_atomic_fn(args.trace_path, timing_ns::trace_json_fn(events));
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "mfetch: " << e.what() << "\n";
+                }
+            }
+        }
+};
+
+// --get: raw values for a shell prompt, one record per value (per item for
+// indexed keys; an empty record when there is none). Runs only the probes
+// behind the keys asked for and reads no config.
+int get_fn(const args_t &args, sysinfo_ns::sysinfo_t &sys)
+{
+    struct want_t
+    {
+            facts_ns::key_t key{};
+            int slot = -1; // plugin registry slot, or -1 for a builtin key
+    };
+
+    std::vector<want_t> wants;
+    std::bitset<facts_ns::probe_count> probes;
+    for (auto name : util_ns::split_fn(args.get_keys, ','))
+    {
+        name = util_ns::trim_fn(name);
+        want_t w;
+        if (facts_ns::key_from_name_fn(name, w.key))
+            probes.set((size_t)facts_ns::info_fn(w.key).probe);
+        else if (name.find('.') == std::string::npos || (w.slot = plugin_ns::registry_t::instance_fn().intern_fn(name)) < 0)
+        {
+            std::cerr << "mfetch: unknown key '" << name << "' for '--get'\n";
+            return 1;
+        }
+        wants.push_back(w);
+    }
+
+    facts_ns::store_t facts(sys);
+    auto &src = sys.source_fn();
+    if (src.mode_fn() == source_ns::mode_t::live && src.root_fn().empty())
+        factcache_ns::fill_fn(facts, probes);
+
+    char end = args.nul_sep ? '\0' : '\n';
+    std::string out;
+    for (const auto &w : wants)
+    {
+        if (w.slot >= 0)
+        {
+            if (const std::string *v = facts.plugin_fn((size_t)w.slot))
+                out += *v;
+            out += end;
+            continue;
+        }
+        size_t n = facts.count_fn(w.key);
+        for (size_t i = 0; i < n; ++i)
+        {
+            out += facts.get_fn(w.key, i)->text;
+            out += end;
+        }
+        if (n == 0)
+            out += end;
+    }
+
+    // one write, so a prompt reading the pipe never sees half a value
+    for (size_t done = 0; done < out.size();)
+    {
+        ssize_t n = ::write(STDOUT_FILENO, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
 int main_fn(int argc, char **argv)
 {
     try
@@ -34,41 +131,174 @@ int main_fn(int argc, char **argv)
             return 1;
         }
 
-        // default: $HOME/.config/mfetch.conf
-        std::string config_path = std::getenv("HOME") + std::string("/.config/mfetch.conf");
+        if (args.timings || !args.trace_path.empty())
+            timing_ns::enable_fn();
+        timing_guard_t timing_guard{args};
 
-        // Override
-        if (!args.config_path.empty())
+        if (args.containers)
         {
-            config_path = args.config_path;
+            output_ns::mode_t mode = output_ns::mode_t::none;
+            output_ns::parse_mode_fn(args.output, mode);
+            return containers_ns::run_fn(mode, args.all_keys, std::cout);
         }
 
-        config_t config;
+        // Where probes read from: the running system, a sysroot or a snapshot
+        source_ns::source_t source(args.sysroot);
+        if (!args.replay_path.empty())
+            source.load_fn(args.replay_path);
+        sysinfo_ns::sysinfo_t sys(source);
 
-        // Try load
-        if (std::filesystem::exists(config_path))
+        if (!args.get_keys.empty())
+            return get_fn(args, sys);
+
+        if (!args.record_path.empty())
         {
-            config = load_config_fn(config_path);
+            // probe everything so the snapshot renders any config, then
+            // continue from the snapshot so this run matches a later replay
+            source.record_fn();
+            facts_ns::store_t all(sys);
+            for (size_t k = 0; k < facts_ns::key_count; ++k)
+                all.count_fn((facts_ns::key_t)k);
+            all.probe_installed_plugins_fn();
+            source.save_fn(args.record_path);
+            source.replay_fn();
         }
-        else
+
+        // Prometheus textfile: no config, no rendering
+        if (!args.prometheus_path.empty())
         {
-            if (!args.config_path.empty())
+            facts_ns::store_t facts(sys);
+            facts.probe_installed_plugins_fn();
+            prometheus_ns::export_fn(facts, args.prometheus_path);
+            while (args.interval > 0)
             {
-                std::cerr << "mfetch: cannot access '" << config_path << "': No such file or directory\n";
-                return 1;
+                std::this_thread::sleep_for(std::chrono::seconds(args.interval));
+                // static facts stay cached across ticks; a failed tick (full disk, directory
+                // briefly unwritable) is reported and the next one tries again
+                facts.refresh_fn();
+                try
+                {
+                    prometheus_ns::export_fn(facts, args.prometheus_path);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "mfetch: " << e.what() << "\n";
+                }
             }
+            return 0;
+        }
+
+        // default: the embedded config if built with one, else $HOME/.config/mfetch.conf
+        bool explicit_config = !args.profiles.empty();
+        bool embedded = has_embedded_config && !explicit_config;
+        std::vector<profile_t> profiles = args.profiles;
+        if (embedded)
+            profiles.push_back({"", embedded_origin_fn(), ""});
+        else if (profiles.empty())
+        {
+            const char *home = std::getenv("HOME");
+            profiles.push_back({"", std::string(home ? home : "") + "/.config/mfetch.conf", ""});
+        }
+        auto load_fn = [&](const profile_t &p)
+        {
+            return embedded ? embedded_config_fn() : load_config_fn(p.config_path);
+        };
+
+        // Explicit configs must all exist before anything is probed or written
+        if (explicit_config)
+        {
+            for (const auto &p : profiles)
+            {
+                if (!std::filesystem::exists(p.config_path))
+                {
+                    std::string who = p.name.empty() ? "" : "profile '" + p.name + "': ";
+                    std::cerr << "mfetch: " << who << "cannot access '" << p.config_path << "': No such file or directory\n";
+                    return 1;
+                }
+            }
+        }
+        bool have_config = explicit_config || embedded || std::filesystem::exists(profiles[0].config_path);
+
+        // Machine output: no art, no layout
+        if (!args.output.empty())
+        {
+            facts_ns::store_t facts(sys);
+            std::bitset<facts_ns::key_count> keys;
+            std::vector<size_t> plugins;
+            if (have_config && !args.all_keys)
+            {
+                // compiled once each, for both the fact keys and the plugin keys
+                for (const auto &p : profiles)
+                {
+                    engine_t engine(load_fn(p), facts);
+                    keys |= engine.keys_fn();
+                    engine.plugins_fn(plugins);
+                }
+            }
+
+            output_ns::mode_t mode = output_ns::mode_t::json;
+            output_ns::parse_mode_fn(args.output, mode);
+            // nothing configured (or --all): every built-in key and every installed plugin's
+            if (keys.none() && plugins.empty())
+            {
+                keys.set();
+                facts.probe_installed_plugins_fn();
+                for (size_t s = 0; s < plugin_ns::registry_t::instance_fn().slot_count_fn(); ++s)
+                    plugins.push_back(s);
+            }
+            output_ns::write_fn(mode, facts, keys, std::cout, plugins);
+            return 0;
+        }
 
-            std::cerr << "mfetch: cfg not found !!! (was given: \"" + config_path + "\")\n";
-            config = load_config_fn("");
+        // Try load
+        std::vector<config_t> configs;
+        if (have_config)
+        {
+            for (const auto &p : profiles)
+                configs.push_back(load_fn(p));
+        }
+        else
+        {
+            std::cerr << "mfetch: cfg not found !!! (was given: \"" + profiles[0].config_path + "\")\n";
+            configs.push_back(load_config_fn(""));
         }
 
-        // 2. Initialize Engine
-        engine_t engine(config);
+        // 2. Compile every profile once, then one probe pass for all of them:
+        //    the union of their keys, into one shared store
+        facts_ns::store_t facts(sys);
+        std::vector<engine_t> engines;
+        engines.reserve(configs.size());
+        std::bitset<facts_ns::key_count> keys;
+        for (const auto &c : configs)
+        {
+            engines.emplace_back(c, facts);
+            keys |= engines.back().keys_fn();
+        }
+        for (size_t k = 0; k < facts_ns::key_count; ++k)
+        {
+            if (keys[k])
+                facts.count_fn((facts_ns::key_t)k);
+        }
+
+        // 3. Render each profile
+        for (size_t i = 0; i < profiles.size(); ++i)
+        {
+            const auto &p = profiles[i];
+            engine_t &engine = engines[i];
 
-        // 3. Render
-        engine.render_fn();
+            if (!p.out_path.empty())
+            {
+                std::string out;
+                engine.graphics_fn(false);
+                engine.render_to_fn(out);
+                MFETCH_SCOPE_D("output", p.out_path.c_str());
+                util_ns::write_file_atomic_fn(p.out_path, out);
+                continue;
+            }
 
-        std::cout << "\n\n(used config: \"" + config_path + "\")\n";
+            engine.render_fn();
+            std::cout << "\n\n(used config: \"" + p.config_path + "\")\n";
+        }
     }
     catch (const std::exception &e)
     {
@@ -9,11 +9,31 @@
 
 namespace args_ns
 {
+    // One config to render; -c gives an unnamed one
+    struct profile_t
+    {
+            std::string name;
+            std::string config_path;
+            std::string out_path; // empty = stdout
+    };
+
     struct args_t
     {
             bool show_help = false;
             bool show_version = false;
-            std::string config_path;
+            std::vector<profile_t> profiles; // empty = default config
+            std::string output;    // json, ndjson, kv; empty = normal fetch
+            bool all_keys = false; // machine output: every probed value, not just configured ones
+            std::string prometheus_path;
+            int interval = 0; // seconds between exports, 0 = once
+            bool timings = false;
+            std::string trace_path;
+            std::string sysroot;     // prefix for /proc, /sys and /etc reads
+            std::string record_path; // snapshot of every probe input
+            std::string replay_path;
+            bool containers = false; // one row per running container
+            std::string get_keys;    // --get: comma separated keys, printed raw
+            bool nul_sep = false;    // -0: --get values end in '\0', not '\n'
             bool error = false;
             std::string error_msg;
     };
@@ -23,7 +43,21 @@ namespace args_ns
         std::cout << "usage: mfetch [OPTIONS]\n"
                   << "a minimal fetch tool!\n\n"
                   << "options:\n"
-                  << "  -c, --config <PATH>   use a specific configuration file\n"
+                  << "  -c, --config <PATH>   use a specific configuration file (repeatable)\n"
+                  << "      --profile <NAME=PATH>  like --config, with a name for messages\n"
+                  << "      --out <PATH>      write the preceding config's fetch to PATH instead of stdout\n"
+                  << "  -o, --output <FMT>    print values as json, ndjson or kv instead of the fetch\n"
+                  << "      --all             with --output or --containers, print every value, not just the default ones\n"
+                  << "      --prometheus <PATH>  write numeric values as a node_exporter textfile\n"
+                  << "      --interval <SEC>  with --prometheus, keep running and rewrite every SEC seconds\n"
+                  << "      --timings         print per-probe timings to stderr\n"
+                  << "      --trace <PATH>    write a chrome trace-event file (perfetto, chrome://tracing)\n"
+                  << "      --sysroot <DIR>   read /proc, /sys and /etc under DIR (commands are not run)\n"
+                  << "      --record <PATH>   save every probe input to a snapshot, then render from it\n"
+                  << "      --replay <PATH>   render from a snapshot without reading the system\n"
+                  << "      --containers      one row per running container (-o ndjson for objects)\n"
+                  << "      --get <KEYS>      print just these values (comma separated), one per line\n"
+                  << "  -0                    with --get, end each value with NUL instead of a newline\n"
                   << "  -h, --help            display this and exit\n"
                   << "  -v, --version         output version information and exit\n\n"
                   << "default config location: $HOME/.config/mfetch.conf\n";
@@ -56,7 +90,7 @@ namespace args_ns
             {
                 if (i + 1 < argc)
                 {
-                    args.config_path = argv[++i];
+                    args.profiles.push_back({"", argv[++i], ""});
                 }
                 else
                 {
@@ -65,6 +99,133 @@ namespace args_ns
                     return args;
                 }
             }
+            else if (arg == "--profile")
+            {
+                std::string spec = i + 1 < argc ? argv[++i] : "";
+                auto eq = spec.find('=');
+                if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size())
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--profile' requires NAME=PATH.";
+                    return args;
+                }
+                args.profiles.push_back({spec.substr(0, eq), spec.substr(eq + 1), ""});
+            }
+            else if (arg == "--out")
+            {
+                if (i + 1 < argc && !args.profiles.empty() && args.profiles.back().out_path.empty())
+                {
+                    args.profiles.back().out_path = argv[++i];
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--out' requires a path and must follow its '--config' or '--profile'.";
+                    return args;
+                }
+            }
+            else if (arg == "--output" || arg == "-o")
+            {
+                if (i + 1 < argc)
+                {
+                    args.output = argv[++i];
+                    if (args.output != "json" && args.output != "ndjson" && args.output != "kv")
+                    {
+                        args.error = true;
+                        args.error_msg = "Invalid output format '" + args.output + "' (expected json, ndjson or kv).";
+                        return args;
+                    }
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--output' requires an argument.";
+                    return args;
+                }
+            }
+            else if (arg == "--timings")
+            {
+                args.timings = true;
+            }
+            else if (arg == "--trace")
+            {
+                if (i + 1 < argc)
+                {
+                    args.trace_path = argv[++i];
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--trace' requires an argument.";
+                    return args;
+                }
+            }
+            else if (arg == "--sysroot" || arg == "--record" || arg == "--replay")
+            {
+                if (i + 1 < argc)
+                {
+                    std::string &dst = arg == "--sysroot" ? args.sysroot : arg == "--record" ? args.record_path
+                                                                                              : args.replay_path;
+                    dst = argv[++i];
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '" + arg + "' requires an argument.";
+                    return args;
+                }
+            }
+            else if (arg == "--containers")
+            {
+                args.containers = true;
+            }
+            else if (arg == "--get")
+            {
+                if (i + 1 < argc && argv[i + 1][0] != '\0')
+                {
+                    args.get_keys = argv[++i];
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--get' requires a comma separated list of keys.";
+                    return args;
+                }
+            }
+            else if (arg == "-0")
+            {
+                args.nul_sep = true;
+            }
+            else if (arg == "--all")
+            {
+                args.all_keys = true;
+            }
+            else if (arg == "--prometheus")
+            {
+                if (i + 1 < argc)
+                {
+                    args.prometheus_path = argv[++i];
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--prometheus' requires an argument.";
+                    return args;
+                }
+            }
+            else if (arg == "--interval")
+            {
+                if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+                {
+                    args.interval = std::atoi(argv[++i]);
+                }
+                else
+                {
+                    args.error = true;
+                    args.error_msg = "Option '--interval' requires a positive number of seconds.";
+                    return args;
+                }
+            }
             else if (arg[0] == '-')
             {
                 // Handle GNU-style grouped short options? e.g. -vc path?
@@ -84,6 +245,48 @@ namespace args_ns
             }
         }
 
+        if (args.interval && args.prometheus_path.empty())
+        {
+            args.error = true;
+            args.error_msg = "Option '--interval' only applies to '--prometheus'.";
+        }
+        else if (!args.replay_path.empty() && (!args.record_path.empty() || !args.sysroot.empty()))
+        {
+            args.error = true;
+            args.error_msg = "Option '--replay' cannot be combined with '--record' or '--sysroot'.";
+        }
+        else if (!args.output.empty() && std::any_of(args.profiles.begin(), args.profiles.end(), [](const profile_t &p)
+                                                     { return !p.out_path.empty(); }))
+        {
+            args.error = true;
+            args.error_msg = "Option '--out' only applies to the fetch, not '--output'.";
+        }
+        else if (args.containers && (!args.sysroot.empty() || !args.record_path.empty() || !args.replay_path.empty()))
+        {
+            args.error = true;
+            args.error_msg = "Option '--containers' reads the running host and cannot be combined with '--sysroot', '--record' or '--replay'.";
+        }
+        else if (args.all_keys && args.output.empty() && !args.containers)
+        {
+            args.error = true;
+            args.error_msg = "Option '--all' only applies to '--output' or '--containers'.";
+        }
+        else if (args.nul_sep && args.get_keys.empty())
+        {
+            args.error = true;
+            args.error_msg = "Option '-0' only applies to '--get'.";
+        }
+        else if (!args.get_keys.empty() && (!args.profiles.empty() || !args.output.empty() || args.all_keys || !args.prometheus_path.empty() || !args.record_path.empty() || args.containers))
+        {
+            args.error = true;
+            args.error_msg = "Option '--get' reads no config and cannot be combined with '--config', '--profile', '--output', '--all', '--prometheus', '--record' or '--containers'.";
+        }
+        else if (args.containers && !args.output.empty() && args.output != "ndjson")
+        {
+            args.error = true;
+            args.error_msg = "Option '--containers' supports '--output ndjson' only.";
+        }
+
         return args;
     }
 } // namespace args_ns
@@ -2,12 +2,15 @@
 
 #include "config.hpp"
 #include "sysinfo.hpp"
+#include "facts.hpp"
+#include "format.hpp"
 #include "util.hpp"
-#include <sstream>
+#include "layout.hpp"
+#include "image.hpp"
+#include "timing.hpp"
 #include <vector>
+#include <memory>
 #include <iostream>
-#include <map>
-#include <iomanip>
 
 namespace renderer_ns
 {
@@ -15,268 +18,241 @@ namespace renderer_ns
     using namespace config_ns;
     using namespace util_ns;
 
-    inline std::string fmt_mem_fn(long kb)
-    {
-        double gb = kb / 1024.0 / 1024.0;
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(1) << gb << "g";
-        return ss.str();
-    }
+    using layout_ns::visible_len_fn;
 
-    // Improved visible length for UTF-8 and ANSI
-    inline size_t visible_len_fn(const std::string &s)
+    // Module format with the per-type defaults filled in
+    inline std::string module_format_fn(const module_cfg_t &mod)
     {
-        size_t len = 0;
-        bool in_esc = false;
-        for (size_t i = 0; i < s.size(); ++i)
-        {
-            unsigned char c = s[i];
-            if (c == '\033')
-                in_esc = true;
-            else if (in_esc)
-            {
-                if (c == 'm')
-                    in_esc = false;
-            }
-            else
-            {
-                if ((c & 0xc0) != 0x80)
-                {
-                    len++;
-                }
-            }
-        }
-        return len;
+        if (!mod.format.empty())
+            return mod.format;
+        if (mod.type == "ram")
+            return "{ram_used} / {ram_total}";
+        if (mod.type == "swap")
+            return "{swap_used} / {swap_total}";
+        if (mod.type == "numa")
+            return "cpus {numa_cpus}, {numa_mem_used} / {numa_mem_total}";
+        if (mod.type == "cache")
+            return "{caches}";
+        return "{" + mod.type + "}";
     }
 
     class engine_t
     {
             config_t config;
-            sysinfo_t &sys;
-            std::map<std::string, std::string> ctx_cache;
+            std::unique_ptr<facts_ns::store_t> own_facts; // unless given a shared store
+            facts_ns::store_t &facts;
+            format_ns::unit_t unit;
+            bool graphics = true; // false when the output is not headed for a terminal
 
-            std::string get_val_lazy(const std::string &key)
-            {
-                if (ctx_cache.count(key))
-                    return ctx_cache[key];
+            // compiled once per engine, indexed like config.modules / config.formats
+            std::vector<format_ns::program_t> module_progs;
+            std::vector<format_ns::program_t> format_progs;
 
-                std::string val = "unknown";
-                if (key == "host")
-                    val = util_ns::to_lower_fn(sys.get_hostname_fn());
-                else if (key == "user")
-                    val = util_ns::to_lower_fn(sys.get_username_fn());
-                else if (key == "kernel")
-                    val = util_ns::to_lower_fn(sys.get_kernel_fn());
-                else if (key == "os")
-                    val = util_ns::to_lower_fn(sys.get_os_fn());
-                else if (key == "cpu")
-                    val = util_ns::to_lower_fn(sys.get_cpu_fn());
-                else if (key == "sh")
-                    val = util_ns::to_lower_fn(sys.get_shell_fn());
-                else if (key == "term")
-                    val = util_ns::to_lower_fn(sys.get_term_fn());
-                else if (key == "proc")
-                    val = sys.get_proc_count_fn();
-                else if (key == "wm")
-                    val = sys.get_wm_fn();
-                else if (key == "de")
-                    val = sys.get_de_fn();
-                else if (key == "ram_used" || key == "ram_total" || key == "swap_used" || key == "swap_total")
-                {
-                    // Fetch mem once
-                    if (ctx_cache.find("ram_used") == ctx_cache.end())
-                    {
-                        auto mem = sys.get_mem_fn();
-                        ctx_cache["ram_used"] = fmt_mem_fn(mem.used);
-                        ctx_cache["ram_total"] = fmt_mem_fn(mem.total);
-                        ctx_cache["swap_used"] = fmt_mem_fn(mem.swap_used);
-                        ctx_cache["swap_total"] = fmt_mem_fn(mem.swap_total);
-                    }
-                    val = ctx_cache[key];
-                }
-                else if (key == "pkgs")
-                {
-                    auto p = sys.get_pkgs_fn();
-                    std::string s = "";
-                    for (size_t i = 0; i < p.size(); ++i)
-                    {
-                        if (i > 0)
-                            s += ", ";
-                        s += std::to_string(p[i].count) + " " + p[i].manager;
-                    }
-                    if (s.empty())
-                        s = "0";
-                    val = s;
-                }
-
-                ctx_cache[key] = val;
-                return val;
+            static bool is_text_type_fn(const std::string &t)
+            {
+                return t == "text" || t == "sep" || t == "empty" || t == "host" || t == "title";
             }
 
-            // Helper to resolve string with lazy fetches
-            std::string resolve(std::string fmt)
+            // A machine without a detected gpu still gets its gpu row, reading "unknown";
+            // the probe itself reports none, so typed output says [] rather than a placeholder
+            size_t rows_of_fn(const format_ns::program_t &p)
             {
-                size_t start_pos = 0;
-                while ((start_pos = fmt.find('{', start_pos)) != std::string::npos)
-                {
-                    size_t end_pos = fmt.find('}', start_pos);
-                    if (end_pos == std::string::npos)
-                        break;
+                if (p.iter_key < 0)
+                    return 1;
+                size_t n = facts.count_fn((facts_ns::key_t)p.iter_key);
+                return n == 0 && p.iter_key == (int)facts_ns::key_t::gpu ? 1 : n;
+            }
 
-                    std::string key = fmt.substr(start_pos + 1, end_pos - start_pos - 1);
-                    std::string val = get_val_lazy(key);
+            void compile_fn()
+            {
+                MFETCH_SCOPE("format:compile");
+                module_progs.reserve(config.modules.size());
+                for (const auto &mod : config.modules)
+                    module_progs.push_back(format_ns::compile_fn(module_format_fn(mod), mod.type));
 
-                    fmt.replace(start_pos, end_pos - start_pos + 1, val);
-                    start_pos += val.length();
-                }
-                return fmt;
+                format_progs.reserve(config.formats.size());
+                for (const auto &f : config.formats)
+                    format_progs.push_back(format_ns::compile_fn(f.second, f.first));
             }
 
         public:
-            engine_t(const config_t &c) : config(c), sys(sysinfo_t::instance_fn())
+            engine_t(const config_t &c, sysinfo_t &sys = sysinfo_t::instance_fn()) : config(c), own_facts(std::make_unique<facts_ns::store_t>(sys)), facts(*own_facts), unit(format_ns::parse_unit_fn(c.unit))
             {
+                compile_fn();
             }
 
-            void render_fn()
+            // Renders from a store shared with other engines; probes already cached there are not run again
+            engine_t(const config_t &c, facts_ns::store_t &shared) : config(c), facts(shared), unit(format_ns::parse_unit_fn(c.unit))
             {
-                // 1. Pre-calculate layout (labels and expansion)
-                // We need to expand GPUs and determine max label width BEFORE printing anything
-                // to maintain alignment.
+                compile_fn();
+            }
 
-                struct render_item_t
-                {
-                        int type; // 0=text/title, 1=pair
-                        std::string label_text;
-                        std::string value_fmt;   // format string or key
-                        std::string color;       // output color (legacy/fallback)
-                        std::string color_label; // label color
-                        int indent;
+            // Every fact key the modules and [format] rows read, from the programs compiled above
+            std::bitset<facts_ns::key_count> keys_fn() const
+            {
+                std::bitset<facts_ns::key_count> keys;
+                for (const auto &p : module_progs)
+                    format_ns::collect_keys_fn(p, keys);
+                for (const auto &p : format_progs)
+                    format_ns::collect_keys_fn(p, keys);
+                return keys;
+            }
 
-                        // For direct value items (gpus expanded)
-                        std::string direct_value;
-                };
+            // Plugin keys the programs use, as registry slots (appended, no duplicates)
+            void plugins_fn(std::vector<size_t> &slots) const
+            {
+                for (const auto &p : module_progs)
+                    format_ns::collect_plugins_fn(p, slots);
+                for (const auto &p : format_progs)
+                    format_ns::collect_plugins_fn(p, slots);
+            }
 
-                std::vector<render_item_t> items;
+            // Off for --out files: graphics escapes only make sense on the terminal that decoded them
+            void graphics_fn(bool on)
+            {
+                graphics = on;
+            }
+
+            void render_to_fn(std::string &out)
+            {
+                // 1. Label widths, counting expanded rows (gpu0, gpu1, ...)
                 size_t max_label_w = 0;
+                for (size_t m = 0; m < config.modules.size(); ++m)
+                {
+                    const auto &mod = config.modules[m];
+                    if (is_text_type_fn(mod.type))
+                        continue;
+                    size_t n = rows_of_fn(module_progs[m]);
+                    size_t lw = visible_len_fn(mod.label.empty() ? mod.type : mod.label);
+                    if (n > 1)
+                        lw += std::to_string(n - 1).size();
+                    if (lw > max_label_w)
+                        max_label_w = lw;
+                }
 
-                // Pre-fetch GPUs for expansion (relatively fast)
-                auto gpus = sys.get_gpus_fn();
+                // 2. Resolve every row up front so the layout is right on the first paint
+                layout_ns::block_t info;
+                format_ns::run_ctx_t ctx{facts, unit};
+                std::string row;
 
-                for (const auto &mod : config.modules)
+                for (size_t m = 0; m < config.modules.size(); ++m)
                 {
-                    if (mod.type == "gpu")
+                    const auto &mod = config.modules[m];
+                    const auto &prog = module_progs[m];
+                    size_t n = rows_of_fn(prog);
+
+                    for (size_t i = 0; i < n; ++i)
                     {
-                        for (size_t i = 0; i < gpus.size(); ++i)
+                        MFETCH_SCOPE_D("render:row", mod.type.c_str());
+                        ctx.index = i;
+                        row.clear();
+
+                        std::string out_color = !mod.color_out.empty() ? mod.color_out : mod.color;
+                        if (is_text_type_fn(mod.type))
+                        {
+                            out_color = mod.color;
+                        }
+                        else
                         {
-                            std::string lbl = mod.label.empty() ? "gpu" : mod.label;
-                            if (gpus.size() > 1)
+                            std::string lbl = mod.label.empty() ? mod.type : mod.label;
+                            if (n > 1)
                                 lbl += std::to_string(i);
+                            if (mod.type == "gpu" && out_color.empty())
+                                out_color = "white";
 
-                            std::string val = util_ns::to_lower_fn(gpus[i].name);
-                            size_t lw = visible_len_fn(lbl);
-                            if (lw > max_label_w)
-                                max_label_w = lw;
-
-                            std::string out_color = !mod.color_out.empty() ? mod.color_out : (!mod.color.empty() ? mod.color : "white");
-                            std::string lbl_color = !mod.color_label.empty() ? mod.color_label : "white";
-                            items.push_back({1, lbl, "", out_color, lbl_color, mod.indent, val});
+                            size_t l_len = visible_len_fn(lbl);
+                            row.append(max_label_w > l_len ? max_label_w - l_len : 0, ' ');
+                            row += color_fn(lbl, !mod.color_label.empty() ? mod.color_label : "white");
+                            row += " - ";
                         }
-                    }
-                    else if (mod.type == "text" || mod.type == "sep" || mod.type == "empty" || mod.type == "host" || mod.type == "title")
-                    {
-                        items.push_back({0, "", mod.format, mod.color, "", mod.indent, ""});
-                    }
-                    else
-                    {
-                        // Regular Key-Value
-                        std::string lbl = mod.label.empty() ? mod.type : mod.label;
-                        size_t lw = visible_len_fn(lbl);
-                        if (lw > max_label_w)
-                            max_label_w = lw;
 
-                        std::string fmt = mod.format;
-                        if (fmt.empty())
-                        {
-                            if (mod.type == "ram")
-                                fmt = "{ram_used} / {ram_total}";
-                            else if (mod.type == "swap")
-                                fmt = "{swap_used} / {swap_total}";
-                            else
-                                fmt = "{" + mod.type + "}";
-                        }
+                        std::string sgr = sgr_fn(out_color);
+                        row += sgr;
+                        format_ns::run_fn(prog, ctx, row);
+                        if (!sgr.empty())
+                            row += "\033[0m";
 
-                        std::string out_color = !mod.color_out.empty() ? mod.color_out : mod.color;
-                        std::string lbl_color = !mod.color_label.empty() ? mod.color_label : "white";
-                        items.push_back({1, lbl, fmt, out_color, lbl_color, mod.indent, ""});
+                        info.push_fn(row, mod.indent);
                     }
                 }
 
-                // 2. Procedural Print Loop
-                std::vector<std::string> art = split_fn(config.ascii_art, '\n');
-                size_t art_w = 0;
-                for (const auto &s : art)
+                // [format] rows: the template is the whole line
+                int step = config.display_indent * config.indent_multiplier;
+                for (size_t f = 0; f < format_progs.size(); ++f)
                 {
-                    size_t l = visible_len_fn(s);
-                    if (l > art_w)
-                        art_w = l;
+                    const auto &prog = format_progs[f];
+                    size_t n = rows_of_fn(prog);
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        MFETCH_SCOPE_D("render:row", config.formats[f].first.c_str());
+                        ctx.index = i;
+                        row.clear();
+                        format_ns::run_fn(prog, ctx, row);
+                        info.push_fn(row, std::max(prog.depth, 0) * step);
+                    }
                 }
 
-                size_t total_rows = std::max(art.size(), items.size());
-
-                for (size_t i = 0; i < total_rows; ++i)
+                // [image] reserves a box of blank cells and draws over it once the text is out
+                layout_ns::term_size_t term = layout_ns::query_term_fn();
+                image_ns::logo_t logo;
+                if (graphics && !config.image_path.empty())
                 {
-                    // A. Print Left side (ASCII)
-                    std::string a = (i < art.size()) ? art[i] : "";
-                    size_t alen = visible_len_fn(a);
-                    size_t pad_base = (art_w > alen) ? art_w - alen : 0;
-
-                    std::cout << " " << a;
+                    image_ns::protocol_t proto = image_ns::parse_protocol_fn(config.image_protocol);
+                    std::string err;
+                    if (proto != image_ns::protocol_t::none &&
+                        !image_ns::load_fn(config.image_path, (size_t)std::max(config.image_width, 0), (size_t)std::max(config.image_height, 0), proto, term, logo, err))
+                        std::cerr << "mfetch: image: " << err << ", using the ascii art\n";
+                }
 
-                    // B. Print Separator/Indent
-                    if (i < items.size())
+                layout_ns::block_t art;
+                if (!logo.payload.empty())
+                {
+                    for (size_t r = 0; r < logo.rows; ++r)
+                        art.push_fn(std::string(logo.cols, ' '));
+                }
+                else
+                {
+                    auto lines = split_fn(config.ascii_art, '\n');
+                    bool measured = config.art_widths.size() == lines.size();
+                    for (size_t i = 0; i < lines.size(); ++i)
                     {
-                        auto &item = items[i];
-                        int spaces = (int)pad_base + config.gap_size + item.indent;
-                        if (spaces < 1)
-                            spaces = 1;
-                        std::cout << std::string(spaces, ' ');
-
-                        // C. Print Item Info
-                        if (item.type == 0)
-                        {
-                            // Text/Title - Resolve immediately (might pause here if it was slow data)
-                            // Usually titles are fast.
-                            std::string t = resolve(item.value_fmt);
-                            if (!item.color.empty())
-                                t = color_fn(t, item.color);
-                            std::cout << t;
-                        }
+                        if (measured)
+                            art.push_measured_fn(std::move(lines[i]), config.art_widths[i]);
                         else
-                        {
-                            // Label - Value pair
-                            // Print Label
-                            size_t l_len = visible_len_fn(item.label_text);
-                            size_t p = (max_label_w > l_len) ? (max_label_w - l_len) : 0;
-                            std::cout << std::string(p, ' ') << color_fn(item.label_text, item.color_label) << " - ";
-                            std::cout.flush(); // FORCE OUTPUT BEFORE FETCHING VALUE
-
-                            // Fetch Value
-                            std::string val = item.direct_value;
-                            if (val.empty())
-                                val = resolve(item.value_fmt);
-
-                            if (!item.color.empty())
-                                val = color_fn(val, item.color);
-
-                            std::cout << val;
-                        }
+                            art.push_fn(std::move(lines[i]));
                     }
-
-                    std::cout << "\n";
-                    // Only flush if we are doing procedural stuff
-                    // With package manager loops, it's nice to flush.
-                    std::cout.flush();
                 }
+
+                // 3. Place and serialise
+                layout_ns::layout_opts_t opts;
+                opts.position = layout_ns::parse_position_fn(config.ascii_position);
+                opts.margin = (size_t)std::max(config.ascii_margin, 0);
+                opts.gap = (size_t)std::max(config.gap_size, 0);
+                opts.art_min_w = (size_t)std::max(config.ascii_min_width, 0);
+                opts.top_padding = (size_t)std::max(config.top_padding, 0);
+                opts.bottom_padding = (size_t)std::max(config.bottom_padding, 0);
+                opts.term_cols = term.cols;
+
+                MFETCH_SCOPE("layout");
+                layout_ns::placed_t placed = layout_ns::compose_fn(art, info, opts, out);
+                if (logo.payload.empty() || placed.position == layout_ns::position_t::none)
+                    return;
+
+                // save cursor, back up to the box's top-left cell, draw, restore
+                out += "\0337\033[" + std::to_string(placed.rows - placed.row) + "A\r";
+                if (placed.col)
+                    out += "\033[" + std::to_string(placed.col) + "C";
+                out += logo.payload;
+                out += "\0338";
+            }
+
+            void render_fn()
+            {
+                std::string out;
+                render_to_fn(out);
+                MFETCH_SCOPE("output");
+                std::cout << out;
+                std::cout.flush();
             }
     };
 } // namespace renderer_ns
@@ -2,7 +2,12 @@
 
 #include <string>
 #include <vector>
-#include <fstream>
+#include <string_view>
+#include <cstdlib>
+#include <climits>
+#include <array>
+#include "toml.hpp"
+#include "timing.hpp"
 
 namespace config_ns
 {
@@ -22,39 +27,212 @@ namespace config_ns
             std::string ascii_art;
             std::string ascii_position = "left";
             int ascii_margin = 1;
+            int ascii_min_width = 0; // [ascii] min_width: the art column is at least this wide, wider art is not clipped
             int gap_size = 2;
 
+            int top_padding = 0;
+            int bottom_padding = 0;
+            int display_indent = 0;
+            int indent_multiplier = 1;
+            std::string unit; // display unit for byte values, see format_ns::parse_unit_fn
+
+            // [image] - drawn instead of ascii_art when the terminal speaks a graphics protocol
+            std::string image_path;              // absolute, or relative to the config file
+            int image_width = 0;                 // cells, 0 = 24
+            int image_height = 0;                // cells, 0 = keep the aspect ratio
+            std::string image_protocol = "auto"; // auto, kitty, sixel, none
+
             std::vector<module_cfg_t> modules;
+            // [format] section, in file order: row name -> template
+            std::vector<std::pair<std::string, std::string>> formats;
+
+            // visible width of each ascii_art line, precomputed for embedded configs; empty = measure
+            std::vector<size_t> art_widths;
     };
 
-    inline std::string trim_val_fn(std::string s)
+    // Shapes of the constexpr data tools/embed_config.cpp generates
+    struct embedded_module_t
     {
-        auto first = s.find_first_not_of(" \t\r\n");
-        if (first == std::string::npos)
-            return "";
-        auto last = s.find_last_not_of(" \t\r\n");
-        return s.substr(first, last - first + 1);
-    }
+            std::string_view type, format, label, color, color_label, color_out;
+            int indent;
+    };
+
+    struct embedded_format_t
+    {
+            std::string_view name, tmpl;
+    };
+
+    namespace detail
+    {
+        enum class section_t
+        {
+            root,
+            ascii,
+            display,
+            format,
+            image,
+            module,
+            unknown, // warned about once, at its header
+        };
+
+        // Maps parsed TOML onto config_t
+        struct loader_t
+        {
+                config_t &cfg;
+                const std::string &path;
+                section_t section = section_t::root;
+
+                [[noreturn]] void type_fn(std::string_view key, const toml_ns::value_t &v, const char *want) const
+                {
+                    toml_ns::error_fn(path, v.pos, "'" + std::string(key) + "' must be " + want + ", not " + v.kind_name_fn());
+                }
+
+                std::string str_fn(std::string_view key, const toml_ns::value_t &v) const
+                {
+                    if (v.kind != toml_ns::kind_t::string)
+                        type_fn(key, v, "a string");
+                    return v.str_fn();
+                }
+
+                int int_fn(std::string_view key, const toml_ns::value_t &v) const
+                {
+                    if (v.kind != toml_ns::kind_t::integer)
+                        type_fn(key, v, "an integer");
+                    if (v.integer < INT_MIN || v.integer > INT_MAX)
+                        toml_ns::error_fn(path, v.pos, "'" + std::string(key) + "' is out of range");
+                    return (int)v.integer;
+                }
+
+                // relative to the config file, ~ for $HOME
+                std::string resolve_fn(std::string val) const
+                {
+                    auto slash = path.rfind('/');
+                    if (!val.empty() && val[0] == '~')
+                    {
+                        const char *home = std::getenv("HOME");
+                        val = std::string(home ? home : "") + val.substr(1);
+                    }
+                    else if (!val.empty() && val[0] != '/' && slash != std::string::npos)
+                        val = path.substr(0, slash + 1) + val;
+                    return val;
+                }
+
+                void table_fn(std::string_view name, bool array, toml_ns::pos_t pos)
+                {
+                    if (array && name == "module")
+                    {
+                        section = section_t::module;
+                        cfg.modules.push_back({});
+                        return;
+                    }
+                    section = section_t::unknown;
+                    if (!array && name == "ascii")
+                        section = section_t::ascii;
+                    else if (!array && name == "display")
+                        section = section_t::display;
+                    else if (!array && name == "format")
+                        section = section_t::format;
+                    else if (!array && name == "image")
+                        section = section_t::image;
+                    else if (name == "module")
+                        toml_ns::warn_fn(path, pos, "modules are [[module]], ignoring [module]");
+                    else
+                        toml_ns::warn_fn(path, pos, "unknown table " + std::string(array ? "[[" : "[") + std::string(name) + (array ? "]]" : "]"));
+                }
+
+                void value_fn(std::string_view key, toml_ns::pos_t kpos, const toml_ns::value_t &v)
+                {
+                    switch (section)
+                    {
+                        case section_t::root:
+                            if (key == "gap_size")
+                                return void(cfg.gap_size = int_fn(key, v));
+                            break;
+
+                        case section_t::ascii:
+                            if (key == "art")
+                                return void(cfg.ascii_art = str_fn(key, v));
+                            if (key == "position")
+                                return void(cfg.ascii_position = str_fn(key, v));
+                            // "width" is the older spelling; art is never clipped to it
+                            if (key == "min_width" || key == "width")
+                                return void(cfg.ascii_min_width = int_fn(key, v));
+                            if (key == "padding" || key == "gap_size")
+                                return void(cfg.gap_size = int_fn(key, v));
+                            if (key == "margin")
+                                return void(cfg.ascii_margin = int_fn(key, v));
+                            break;
+
+                        case section_t::display:
+                            if (key == "top_padding")
+                                return void(cfg.top_padding = int_fn(key, v));
+                            if (key == "bottom_padding")
+                                return void(cfg.bottom_padding = int_fn(key, v));
+                            if (key == "indent")
+                                return void(cfg.display_indent = int_fn(key, v));
+                            if (key == "indent_multiplier")
+                                return void(cfg.indent_multiplier = int_fn(key, v));
+                            if (key == "unit")
+                                return void(cfg.unit = str_fn(key, v));
+                            break;
+
+                        case section_t::format:
+                            // every key is a row name
+                            cfg.formats.push_back({std::string(key), str_fn(key, v)});
+                            return;
+
+                        case section_t::image:
+                            if (key == "path")
+                                return void(cfg.image_path = resolve_fn(str_fn(key, v)));
+                            if (key == "width")
+                                return void(cfg.image_width = int_fn(key, v));
+                            if (key == "height")
+                                return void(cfg.image_height = int_fn(key, v));
+                            if (key == "protocol")
+                                return void(cfg.image_protocol = str_fn(key, v));
+                            break;
+
+                        case section_t::module:
+                        {
+                            auto &m = cfg.modules.back();
+                            if (key == "type")
+                                return void(m.type = str_fn(key, v));
+                            if (key == "format")
+                                return void(m.format = str_fn(key, v));
+                            if (key == "label")
+                                return void(m.label = str_fn(key, v));
+                            if (key == "color")
+                                return void(m.color = str_fn(key, v));
+                            if (key == "color_label")
+                                return void(m.color_label = str_fn(key, v));
+                            if (key == "color_out")
+                                return void(m.color_out = str_fn(key, v));
+                            if (key == "indent")
+                                return void(m.indent = int_fn(key, v));
+                            break;
+                        }
 
-    // Simple robust custom TOML-subset parser
-    // Supports [ascii] block for 'art' multi-line string
-    // Supports [[module]] layout
+                        case section_t::unknown:
+                            return;
+                    }
+                    toml_ns::warn_fn(path, kpos, "unknown key '" + std::string(key) + "'");
+                }
+        };
+    } // namespace detail
+
+    // Parses path; a missing file gives the built-in modules and art.
+    // Syntax and type errors throw with path:line:col, unknown keys only warn.
     inline config_t load_config_fn(const std::string &path)
     {
+        MFETCH_SCOPE_D("config:load", path.c_str());
         config_t cfg;
         // Default ASCII if not found
         cfg.ascii_art = R"(
 ₍^. .^₎⟆ ;)";
 
-        bool in_module = false;
-        bool in_ascii = false;
-        std::string current_art = "";
-        bool capturing_art = false;
-
-        std::ifstream f(path);
-        if (!f.is_open())
+        toml_ns::mapped_file_t file;
+        if (path.empty() || !file.open_fn(path))
         {
-            throw std::runtime_error("cfg not found !!! (was given: \"" + path + "\")");
             // Defaults if no file match
             cfg.modules = {
                 {"host", ">> {user} @ {host} //", "", "", "", "", -4},
@@ -73,87 +251,71 @@ namespace config_ns
             return cfg;
         }
 
-        std::string line;
-        while (std::getline(f, line))
-        {
-            std::string tr = trim_val_fn(line);
-            if (tr.empty() || tr[0] == '#')
-                continue;
-
-            if (tr == "[ascii]")
-            {
-                in_ascii = true;
-                in_module = false;
-                continue;
-            }
-            if (tr == "[[module]]")
-            {
-                in_module = true;
-                in_ascii = false;
-                cfg.modules.push_back({}); // New module
-                continue;
-            }
-
-            if (in_ascii)
-            {
-                if (tr.rfind("art = \"\"\"", 0) == 0 || tr.rfind("art = '''", 0) == 0)
-                {
-                    capturing_art = true;
-                    continue;
-                }
-                if (capturing_art)
-                {
-                    if (tr.rfind("\"\"\"", 0) == 0 || tr.rfind("'''", 0) == 0)
-                    {
-                        capturing_art = false;
-                        cfg.ascii_art = current_art;
-                    }
-                    else
-                    {
-                        current_art += line + "\n";
-                    }
-                }
-            }
-            else if (in_module && !cfg.modules.empty())
-            {
-                auto eq = line.find('=');
-                if (eq != std::string::npos)
-                {
-                    std::string key = trim_val_fn(line.substr(0, eq));
-                    std::string val = trim_val_fn(line.substr(eq + 1));
-                    // Unwrap quotes
-                    if (val.size() >= 2 && (val.front() == '"' || val.front() == '\''))
-                    {
-                        val = val.substr(1, val.size() - 2);
-                    }
+        detail::loader_t loader{cfg, path};
+        toml_ns::parse_fn(file.view_fn(), path, loader);
+        return cfg;
+    }
+} // namespace config_ns
 
-                    auto &m = cfg.modules.back();
-                    if (key == "type")
-                        m.type = val;
-                    else if (key == "format")
-                        m.format = val;
-                    else if (key == "label")
-                        m.label = val;
-                    else if (key == "color")
-                        m.color = val;
-                    else if (key == "color_label")
-                        m.color_label = val;
-                    else if (key == "color_out")
-                        m.color_out = val;
-                    else if (key == "indent")
-                    {
-                        try
-                        {
-                            m.indent = std::stoi(val);
-                        }
-                        catch (...)
-                        {
-                        }
-                    }
-                }
-            }
-        }
+// -DMFETCH_EMBEDDED_CONFIG: a config compiled in by `task build-embedded`,
+// used unless --config / --profile name a file
+#ifdef MFETCH_EMBEDDED_CONFIG
+#include "mfetch_embedded.hpp"
+#endif
 
+namespace config_ns
+{
+#ifdef MFETCH_EMBEDDED_CONFIG
+    inline constexpr bool has_embedded_config = true;
+
+    // Copies the generated data into a config_t: no file, no parsing
+    inline config_t embedded_config_fn()
+    {
+        MFETCH_SCOPE("config:embedded");
+        namespace e = embedded_ns;
+        config_t cfg;
+        cfg.ascii_art = e::ascii_art;
+        cfg.art_widths.assign(e::art_widths.begin(), e::art_widths.end());
+        cfg.ascii_position = e::ascii_position;
+        cfg.ascii_margin = e::ascii_margin;
+        cfg.ascii_min_width = e::ascii_min_width;
+        cfg.gap_size = e::gap_size;
+        cfg.top_padding = e::top_padding;
+        cfg.bottom_padding = e::bottom_padding;
+        cfg.display_indent = e::display_indent;
+        cfg.indent_multiplier = e::indent_multiplier;
+        cfg.unit = e::unit;
+        cfg.image_path = e::image_path;
+        cfg.image_width = e::image_width;
+        cfg.image_height = e::image_height;
+        cfg.image_protocol = e::image_protocol;
+
+        cfg.modules.reserve(e::modules.size());
+        for (const auto &m : e::modules)
+            cfg.modules.push_back({std::string(m.type), std::string(m.format), std::string(m.label), std::string(m.color),
+                                   std::string(m.color_label), std::string(m.color_out), m.indent});
+        cfg.formats.reserve(e::formats.size());
+        for (const auto &f : e::formats)
+            cfg.formats.push_back({std::string(f.name), std::string(f.tmpl)});
         return cfg;
     }
+
+    // Shown where a file path would be, "embedded:data/mfetch.conf"
+    inline std::string embedded_origin_fn()
+    {
+        return "embedded:" + std::string(embedded_ns::origin);
+    }
+#else
+    inline constexpr bool has_embedded_config = false;
+
+    inline config_t embedded_config_fn()
+    {
+        return load_config_fn("");
+    }
+
+    inline std::string embedded_origin_fn()
+    {
+        return "";
+    }
+#endif
 } // namespace config_ns
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "source.hpp"
+#include "sysinfo.hpp"
+#include "facts.hpp"
+#include "output.hpp"
+#include "numfmt.hpp"
+#include "util.hpp"
+#include "timing.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <bitset>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+
+// --containers: one row per running container, read from the host.
+//
+// A container is the topmost process of a pid namespace, or of a mount
+// namespace that also has its own uts namespace (docker, podman, lxc,
+// nspawn). Services that only unshare mounts (PrivateTmp) are skipped.
+// Each one is probed through /proc/<pid>/root and its memory cgroup;
+// host-wide facts (cpu, gpu, kernel, load, uptime) are probed once.
+namespace containers_ns
+{
+    using facts_ns::key_t;
+    using facts_ns::probe_t;
+
+    struct ns_ids_t
+    {
+            std::string mnt, pid, uts;
+    };
+
+    struct container_t
+    {
+            long pid = 0;
+            std::string cgroup; // host path under /sys/fs/cgroup, "" if unknown
+            bool cgroup_v2 = true;
+
+            std::unique_ptr<source_ns::source_t> source;
+            std::unique_ptr<sysinfo_ns::sysinfo_t> sys;
+            std::unique_ptr<facts_ns::store_t> facts;
+    };
+
+    // Probed once on the host and copied into every container
+    inline constexpr probe_t shared_probes[] = {probe_t::kernel, probe_t::cpu, probe_t::gpu, probe_t::load, probe_t::uptime, probe_t::temps,
+                                                 probe_t::topology, probe_t::numa};
+
+    // What a container row shows; env-derived facts (user, sh, term, wm, de) describe mfetch's caller, not the container
+    inline std::bitset<facts_ns::key_count> default_keys_fn()
+    {
+        std::bitset<facts_ns::key_count> keys;
+        for (key_t k : {key_t::host, key_t::os, key_t::kernel, key_t::cpu, key_t::gpu, key_t::proc, key_t::ram_used,
+                        key_t::ram_total, key_t::swap_used, key_t::swap_total, key_t::load1, key_t::uptime})
+            keys.set((size_t)k);
+        return keys;
+    }
+
+    inline std::string ns_link_fn(long pid, const char *ns)
+    {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/%ld/ns/%s", pid, ns);
+        char buf[64];
+        ssize_t n = ::readlink(path, buf, sizeof(buf));
+        return n > 0 ? std::string(buf, (size_t)n) : std::string();
+    }
+
+    inline ns_ids_t ns_ids_fn(long pid)
+    {
+        return {ns_link_fn(pid, "mnt"), ns_link_fn(pid, "pid"), ns_link_fn(pid, "uts")};
+    }
+
+    // Memory cgroup of pid as a host directory. v2 "0::/path", v1 "N:...memory...:/path"
+    inline bool cgroup_of_fn(source_ns::source_t &host, long pid, std::string &dir, bool &v2)
+    {
+        std::string data;
+        if (!host.read_fn("/proc/" + std::to_string(pid) + "/cgroup", data))
+            return false;
+        for (const auto &line : util_ns::split_fn(data, '\n'))
+        {
+            auto c1 = line.find(':');
+            auto c2 = c1 == std::string::npos ? c1 : line.find(':', c1 + 1);
+            if (c2 == std::string::npos)
+                continue;
+            std::string ctrls = line.substr(c1 + 1, c2 - c1 - 1);
+            std::string path = line.substr(c2 + 1);
+            if (line.compare(0, c1, "0") == 0 && ctrls.empty())
+            {
+                dir = "/sys/fs/cgroup" + path;
+                v2 = true;
+                return true;
+            }
+            if (("," + ctrls + ",").find(",memory,") != std::string::npos)
+            {
+                dir = "/sys/fs/cgroup/memory" + path;
+                v2 = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Container init pids, lowest first
+    inline std::vector<long> discover_fn(source_ns::source_t &host)
+    {
+        MFETCH_SCOPE("containers:discover");
+        ns_ids_t self = ns_ids_fn(getpid());
+
+        std::vector<long> pids;
+        for (const auto &name : host.list_fn("/proc"))
+        {
+            if (std::all_of(name.begin(), name.end(), ::isdigit))
+                pids.push_back(std::atol(name.c_str()));
+        }
+        std::sort(pids.begin(), pids.end());
+
+        std::vector<long> inits;
+        std::vector<std::string> seen; // one row per mount namespace
+        for (long pid : pids)
+        {
+            ns_ids_t ns = ns_ids_fn(pid);
+            if (ns.mnt.empty() || ns.mnt == self.mnt)
+                continue;
+            if (std::find(seen.begin(), seen.end(), ns.mnt) != seen.end())
+                continue;
+
+            long ppid = sysinfo_ns::parent_pid_fn(host, std::to_string(pid));
+            ns_ids_t parent = ppid > 0 ? ns_ids_fn(ppid) : ns_ids_t{};
+            bool pid_root = ns.pid != parent.pid;
+            bool mnt_root = ns.mnt != parent.mnt && ns.uts != parent.uts;
+            if (!pid_root && !mnt_root)
+                continue;
+
+            seen.push_back(ns.mnt);
+            inits.push_back(pid);
+        }
+        return inits;
+    }
+
+    inline void probe_fn(container_t &c, const std::bitset<facts_ns::key_count> &keys)
+    {
+        MFETCH_SCOPE_D("containers:probe", c.cgroup.c_str());
+        for (size_t k = 0; k < facts_ns::key_count; ++k)
+        {
+            if (keys[k])
+                c.facts->count_fn((key_t)k);
+        }
+    }
+
+    // "1234     web-1    Alpine Linux v3.19      3  0.1g / 0.5g"
+    inline void row_fn(output_ns::sink_t &sink, container_t &c)
+    {
+        auto text = [&](key_t k) -> std::string
+        {
+            const auto *v = c.facts->get_fn(k);
+            return v ? v->text : "?";
+        };
+        auto mem = [&](key_t k) -> std::string
+        {
+            const auto *v = c.facts->get_fn(k);
+            return v ? numfmt_ns::bytes_fn(v->num) : "?";
+        };
+
+        char line[512];
+        std::snprintf(line, sizeof(line), "%-8ld %-20.20s %-32.32s %6s  %s / %s\n", c.pid, text(key_t::host).c_str(), text(key_t::os).c_str(),
+                      text(key_t::proc).c_str(), mem(key_t::ram_used).c_str(), mem(key_t::ram_total).c_str());
+        sink.write_fn(line);
+    }
+
+    // mode: none for rows, ndjson for one object per container
+    inline int run_fn(output_ns::mode_t mode, bool all_keys, std::ostream &os)
+    {
+        source_ns::source_t &host = source_ns::source_t::live_fn();
+        std::vector<long> inits = discover_fn(host);
+
+        auto keys = all_keys ? std::bitset<facts_ns::key_count>().set() : default_keys_fn();
+
+        std::bitset<facts_ns::probe_count> wanted;
+        for (size_t k = 0; k < facts_ns::key_count; ++k)
+        {
+            if (keys[k])
+                wanted.set((size_t)facts_ns::key_table[k].probe);
+        }
+
+        // host-wide facts first, on this thread
+        facts_ns::store_t host_facts(sysinfo_ns::sysinfo_t::instance_fn());
+        std::vector<container_t> ctrs(inits.size());
+        for (size_t i = 0; i < inits.size(); ++i)
+        {
+            auto &c = ctrs[i];
+            c.pid = inits[i];
+            c.source = std::make_unique<source_ns::source_t>("/proc/" + std::to_string(c.pid) + "/root");
+            c.sys = std::make_unique<sysinfo_ns::sysinfo_t>(*c.source);
+            if (cgroup_of_fn(host, c.pid, c.cgroup, c.cgroup_v2))
+                c.sys->use_cgroup_fn(host, c.cgroup, c.cgroup_v2);
+            c.facts = std::make_unique<facts_ns::store_t>(*c.sys);
+            for (probe_t p : shared_probes)
+            {
+                if (wanted[(size_t)p])
+                    c.facts->share_fn(host_facts, p);
+            }
+        }
+
+        // per-container probes only read files, spread them over a pool
+        size_t workers = std::min<size_t>(ctrs.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::atomic<size_t> next{0};
+        auto work = [&]
+        {
+            for (size_t i; (i = next.fetch_add(1)) < ctrs.size();)
+                probe_fn(ctrs[i], keys);
+        };
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < workers; ++w)
+            pool.emplace_back(work);
+        work();
+        for (auto &t : pool)
+            t.join();
+
+        MFETCH_SCOPE("output");
+        output_ns::sink_t sink(os);
+        if (mode == output_ns::mode_t::ndjson)
+        {
+            output_ns::json_writer_t w(sink, false);
+            for (auto &c : ctrs)
+            {
+                w.begin_object_fn();
+                w.key_fn("pid");
+                w.number_fn(c.pid);
+                w.key_fn("cgroup");
+                w.string_fn(c.cgroup);
+                output_ns::fields_fn(w, *c.facts, keys);
+                w.end_object_fn();
+                w.newline_fn();
+            }
+            return 0;
+        }
+
+        char head[256];
+        std::snprintf(head, sizeof(head), "%-8s %-20s %-32s %6s  %s\n", "PID", "HOST", "OS", "PROCS", "MEM");
+        sink.write_fn(head);
+        for (auto &c : ctrs)
+            row_fn(sink, c);
+        return 0;
+    }
+} // namespace containers_ns
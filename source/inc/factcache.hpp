@@ -0,0 +1,274 @@
+#pragma once
+
+#include "facts.hpp"
+#include "source.hpp"
+#include "util.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <bitset>
+#include <optional>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+
+// Probe results kept on disk between runs, for --get: a prompt runs mfetch on
+// every redraw, and walking /sys for the gpus or counting packages each time
+// is most of what such a run costs.
+//
+//   mfetch-facts 3 <key count> <probe count> <schema hash>\n<boot id>\n
+//   then per probe:  P <probe> <unix time> <value count>\n
+//   and per value:   V <key> <num> <text length>\n<text>\n
+//
+// cpu and gpu hold until reboot (the boot id changes). pkgs and topology hold
+// for ttl seconds: cpus can go on- and offline, and smt/control can be written.
+// Keys and probes are stored as enum indices, so the schema line ties the file
+// to this build's key table: an upgrade without a reboot starts over.
+// Everything else is as cheap to read as the cache itself, or changes
+// under us, and is never kept.
+namespace factcache_ns
+{
+    using facts_ns::key_t;
+    using facts_ns::probe_t;
+    using facts_ns::probe_count;
+    using facts_ns::value_t;
+
+    enum class policy_t : uint8_t
+    {
+        never,
+        boot,
+        ttl,
+    };
+
+    inline policy_t policy_fn(probe_t p)
+    {
+        switch (p)
+        {
+            case probe_t::cpu:
+            case probe_t::gpu:
+                return policy_t::boot;
+            case probe_t::pkgs:
+            case probe_t::topology:
+                return policy_t::ttl;
+            default:
+                return policy_t::never;
+        }
+    }
+
+    struct entry_t
+    {
+            long long at = 0; // unix seconds
+            std::vector<std::pair<key_t, value_t>> values;
+    };
+
+    using entries_t = std::array<std::optional<entry_t>, probe_count>;
+
+    namespace detail
+    {
+        // "mfetch-facts 3 <key count> <probe count> <fnv-1a of key names and their probes>"
+        inline const std::string &schema_fn()
+        {
+            static const std::string line = []
+            {
+                uint64_t h = 1469598103934665603ull;
+                auto mix = [&](unsigned char c)
+                {
+                    h ^= c;
+                    h *= 1099511628211ull;
+                };
+                for (const auto &k : facts_ns::key_table)
+                {
+                    for (const char *c = k.name; *c; ++c)
+                        mix((unsigned char)*c);
+                    mix(0);
+                    mix((unsigned char)k.probe);
+                    mix((unsigned char)k.kind);
+                }
+                char buf[96];
+                std::snprintf(buf, sizeof(buf), "mfetch-facts 3 %zu %zu %016llx\n", facts_ns::key_count, probe_count, (unsigned long long)h);
+                return std::string(buf);
+            }();
+            return line;
+        }
+
+        inline bool take_line_fn(std::string_view &data, std::string_view &line)
+        {
+            auto nl = data.find('\n');
+            if (nl == std::string_view::npos)
+                return false;
+            line = data.substr(0, nl);
+            data.remove_prefix(nl + 1);
+            return true;
+        }
+
+        // "<tag> " off the front of s
+        inline bool take_tag_fn(std::string_view &s, char tag)
+        {
+            if (s.size() < 2 || s[0] != tag || s[1] != ' ')
+                return false;
+            s.remove_prefix(2);
+            return true;
+        }
+
+        // Space separated integers off the front of s
+        inline bool take_int_fn(std::string_view &s, long long &v)
+        {
+            while (!s.empty() && s.front() == ' ')
+                s.remove_prefix(1);
+            auto r = std::from_chars(s.data(), s.data() + s.size(), v);
+            if (r.ec != std::errc())
+                return false;
+            s.remove_prefix((size_t)(r.ptr - s.data()));
+            return true;
+        }
+
+        // Any damage drops the rest of the file: it is only a cache
+        inline entries_t parse_fn(std::string_view data, std::string_view boot_id)
+        {
+            entries_t out;
+            std::string_view line;
+            const std::string &schema = schema_fn();
+            if (data.substr(0, schema.size()) != schema)
+                return out;
+            data.remove_prefix(schema.size());
+            if (!take_line_fn(data, line) || line != boot_id)
+                return out;
+
+            while (take_line_fn(data, line))
+            {
+                long long probe, at, count;
+                if (!take_tag_fn(line, 'P') || !take_int_fn(line, probe) || !take_int_fn(line, at) || !take_int_fn(line, count))
+                    break;
+                if (probe < 0 || (size_t)probe >= probe_count || count < 0)
+                    break;
+
+                entry_t e;
+                e.at = at;
+                bool ok = true;
+                for (long long i = 0; ok && i < count; ++i)
+                {
+                    long long key, num, len;
+                    ok = take_line_fn(data, line) && take_tag_fn(line, 'V') && take_int_fn(line, key) && take_int_fn(line, num) && take_int_fn(line, len);
+                    ok = ok && key >= 0 && (size_t)key < facts_ns::key_count && facts_ns::key_table[(size_t)key].probe == (probe_t)probe;
+                    ok = ok && len >= 0 && (size_t)len < data.size() && data[(size_t)len] == '\n';
+                    if (!ok)
+                        break;
+                    value_t v;
+                    v.kind = facts_ns::info_fn((key_t)key).kind;
+                    v.num = num;
+                    v.text = std::string(data.substr(0, (size_t)len));
+                    data.remove_prefix((size_t)len + 1);
+                    e.values.emplace_back((key_t)key, std::move(v));
+                }
+                if (!ok)
+                    break;
+                out[(size_t)probe] = std::move(e);
+            }
+            return out;
+        }
+
+        inline std::string serialize_fn(const entries_t &entries, std::string_view boot_id)
+        {
+            std::string out = schema_fn();
+            out += boot_id;
+            out += '\n';
+            for (size_t p = 0; p < probe_count; ++p)
+            {
+                if (!entries[p])
+                    continue;
+                const entry_t &e = *entries[p];
+                out += "P ";
+                numfmt_ns::append_int_fn(out, (long long)p);
+                out += ' ';
+                numfmt_ns::append_int_fn(out, e.at);
+                out += ' ';
+                numfmt_ns::append_int_fn(out, (long long)e.values.size());
+                out += '\n';
+                for (const auto &kv : e.values)
+                {
+                    out += "V ";
+                    numfmt_ns::append_int_fn(out, (long long)kv.first);
+                    out += ' ';
+                    numfmt_ns::append_int_fn(out, kv.second.num);
+                    out += ' ';
+                    numfmt_ns::append_int_fn(out, (long long)kv.second.text.size());
+                    out += '\n';
+                    out += kv.second.text;
+                    out += '\n';
+                }
+            }
+            return out;
+        }
+    } // namespace detail
+
+    // Serves the cacheable probes among wanted from the cache file when fresh,
+    // runs the others, and rewrites the file if anything was probed anew.
+    // Only meaningful for the running system: a sysroot or snapshot is not cached.
+    inline void fill_fn(facts_ns::store_t &facts, const std::bitset<probe_count> &wanted, long long ttl = 300)
+    {
+        std::bitset<probe_count> cacheable;
+        for (size_t p = 0; p < probe_count; ++p)
+            cacheable[p] = wanted[p] && policy_fn((probe_t)p) != policy_t::never;
+        if (cacheable.none())
+            return;
+
+        MFETCH_SCOPE("factcache");
+        source_ns::source_t disk;
+        std::string boot_id, data;
+        if (!disk.read_line_fn("/proc/sys/kernel/random/boot_id", boot_id) || boot_id.empty())
+            return;
+        std::string path = util_ns::cache_dir_fn() + "/facts";
+        entries_t entries;
+        if (disk.read_fn(path, data))
+            entries = detail::parse_fn(data, boot_id);
+
+        long long now = (long long)std::time(nullptr);
+        bool stale = false;
+        for (size_t p = 0; p < probe_count; ++p)
+        {
+            auto &e = entries[p];
+            bool expired = e && policy_fn((probe_t)p) == policy_t::ttl && (now - e->at >= ttl || e->at > now);
+            if (expired || (e && policy_fn((probe_t)p) == policy_t::never))
+            {
+                e.reset();
+                stale = true;
+            }
+            if (!cacheable[p])
+                continue;
+            if (e)
+            {
+                facts.adopt_fn((probe_t)p, e->values);
+                continue;
+            }
+
+            // run it through the store, then keep what it produced
+            e.emplace();
+            e->at = now;
+            for (size_t k = 0; k < facts_ns::key_count; ++k)
+            {
+                if ((size_t)facts_ns::key_table[k].probe != p)
+                    continue;
+                size_t n = facts.count_fn((key_t)k);
+                for (size_t i = 0; i < n; ++i)
+                    e->values.emplace_back((key_t)k, *facts.get_fn((key_t)k, i));
+            }
+            stale = true;
+        }
+        if (!stale)
+            return;
+
+        // a cache we cannot write only costs the next run its probes
+        std::error_code ec;
+        std::filesystem::create_directories(util_ns::cache_dir_fn(), ec);
+        try
+        {
+            util_ns::write_file_atomic_fn(path, detail::serialize_fn(entries, boot_id));
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+} // namespace factcache_ns
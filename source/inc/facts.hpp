@@ -0,0 +1,678 @@
+#pragma once
+
+#include "sysinfo.hpp"
+#include "plugin.hpp"
+#include "numfmt.hpp"
+#include "util.hpp"
+#include "timing.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cctype>
+#include <cstdlib>
+#include <chrono>
+#include <charconv>
+
+namespace facts_ns
+{
+    using sysinfo_ns::sysinfo_t;
+
+    // Every value mfetch can produce. Indexed keys (gpu, pkg_*, mnt_*) hold one entry per item.
+    enum class key_t : uint8_t
+    {
+        host,
+        user,
+        kernel_name,
+        kernel,
+        os,
+        cpu,
+        sh,
+        term,
+        proc,
+        wm,
+        de,
+        ram_used,
+        ram_total,
+        swap_used,
+        swap_total,
+        gpu,
+        pkgs,
+        pkg_count,
+        pkg_manager,
+        mnt_point,
+        mnt_dev,
+        mnt_part,
+        mnt_used,
+        mnt_total,
+        load1,
+        load5,
+        load15,
+        uptime,
+        temp_zone,
+        temp,
+        topology,
+        sockets,
+        cores,
+        threads,
+        smt,
+        cpus_online,
+        cpus_isolated,
+        caches,
+        cache_l1d,
+        cache_l1i,
+        cache_l2,
+        cache_l3,
+        numa_node,
+        numa_cpus,
+        numa_mem_used,
+        numa_mem_total,
+        count_
+    };
+
+    constexpr size_t key_count = (size_t)key_t::count_;
+
+    enum class kind_t : uint8_t
+    {
+        text,
+        kib,   // raw kB, formatted at render time
+        count, // plain integer
+        milli, // fixed point x1000 (load, degrees C)
+    };
+
+    // One probe fills one or more keys
+    enum class probe_t : uint8_t
+    {
+        host,
+        user,
+        kernel,
+        os,
+        cpu,
+        sh,
+        term,
+        proc,
+        wm,
+        de,
+        mem,
+        gpu,
+        pkgs,
+        mounts,
+        load,
+        uptime,
+        temps,
+        topology,
+        numa,
+        count_
+    };
+
+    constexpr size_t probe_count = (size_t)probe_t::count_;
+
+    inline constexpr std::array<const char *, probe_count> probe_names = {{
+        "probe:host",
+        "probe:user",
+        "probe:kernel",
+        "probe:os",
+        "probe:cpu",
+        "probe:sh",
+        "probe:term",
+        "probe:proc",
+        "probe:wm",
+        "probe:de",
+        "probe:mem",
+        "probe:gpu",
+        "probe:pkgs",
+        "probe:mounts",
+        "probe:load",
+        "probe:uptime",
+        "probe:temps",
+        "probe:topology",
+        "probe:numa",
+    }};
+
+    // How long a probed value stays true within one process
+    enum class volatility_t : uint8_t
+    {
+        fixed, // until reboot / relogin
+        slow,  // changes on package installs, mounts, cpu hotplug
+        live,  // changes every second
+    };
+
+    inline constexpr std::array<volatility_t, probe_count> probe_volatility = {{
+        volatility_t::fixed, // host
+        volatility_t::fixed, // user
+        volatility_t::fixed, // kernel
+        volatility_t::fixed, // os
+        volatility_t::fixed, // cpu
+        volatility_t::fixed, // sh
+        volatility_t::fixed, // term
+        volatility_t::live,  // proc
+        volatility_t::fixed, // wm
+        volatility_t::fixed, // de
+        volatility_t::live,  // mem
+        volatility_t::fixed, // gpu
+        volatility_t::slow,  // pkgs
+        volatility_t::live,  // mounts
+        volatility_t::live,  // load
+        volatility_t::live,  // uptime
+        volatility_t::live,  // temps
+        volatility_t::slow,  // topology (cpu hotplug, smt/control)
+        volatility_t::live,  // numa (per-node memory)
+    }};
+
+    struct key_info_t
+    {
+            const char *name;
+            kind_t kind;
+            probe_t probe;
+            bool indexed;
+    };
+
+    inline constexpr std::array<key_info_t, key_count> key_table = {{
+        {"host", kind_t::text, probe_t::host, false},
+        {"user", kind_t::text, probe_t::user, false},
+        {"kernel_name", kind_t::text, probe_t::kernel, false},
+        {"kernel", kind_t::text, probe_t::kernel, false},
+        {"os", kind_t::text, probe_t::os, false},
+        {"cpu", kind_t::text, probe_t::cpu, false},
+        {"sh", kind_t::text, probe_t::sh, false},
+        {"term", kind_t::text, probe_t::term, false},
+        {"proc", kind_t::count, probe_t::proc, false},
+        {"wm", kind_t::text, probe_t::wm, false},
+        {"de", kind_t::text, probe_t::de, false},
+        {"ram_used", kind_t::kib, probe_t::mem, false},
+        {"ram_total", kind_t::kib, probe_t::mem, false},
+        {"swap_used", kind_t::kib, probe_t::mem, false},
+        {"swap_total", kind_t::kib, probe_t::mem, false},
+        {"gpu", kind_t::text, probe_t::gpu, true},
+        {"pkgs", kind_t::text, probe_t::pkgs, false},
+        {"pkg_count", kind_t::count, probe_t::pkgs, true},
+        {"pkg_manager", kind_t::text, probe_t::pkgs, true},
+        {"mnt_point", kind_t::text, probe_t::mounts, true},
+        {"mnt_dev", kind_t::text, probe_t::mounts, true},
+        {"mnt_part", kind_t::text, probe_t::mounts, true},
+        {"mnt_used", kind_t::kib, probe_t::mounts, true},
+        {"mnt_total", kind_t::kib, probe_t::mounts, true},
+        {"load1", kind_t::milli, probe_t::load, false},
+        {"load5", kind_t::milli, probe_t::load, false},
+        {"load15", kind_t::milli, probe_t::load, false},
+        {"uptime", kind_t::count, probe_t::uptime, false},
+        {"temp_zone", kind_t::text, probe_t::temps, true},
+        {"temp", kind_t::milli, probe_t::temps, true},
+        {"topology", kind_t::text, probe_t::topology, false},
+        {"sockets", kind_t::count, probe_t::topology, false},
+        {"cores", kind_t::count, probe_t::topology, false},
+        {"threads", kind_t::count, probe_t::topology, false},
+        {"smt", kind_t::text, probe_t::topology, false},
+        {"cpus_online", kind_t::text, probe_t::topology, false},
+        {"cpus_isolated", kind_t::text, probe_t::topology, false},
+        {"caches", kind_t::text, probe_t::topology, false},
+        {"cache_l1d", kind_t::kib, probe_t::topology, false},
+        {"cache_l1i", kind_t::kib, probe_t::topology, false},
+        {"cache_l2", kind_t::kib, probe_t::topology, false},
+        {"cache_l3", kind_t::kib, probe_t::topology, false},
+        {"numa_node", kind_t::count, probe_t::numa, true},
+        {"numa_cpus", kind_t::text, probe_t::numa, true},
+        {"numa_mem_used", kind_t::kib, probe_t::numa, true},
+        {"numa_mem_total", kind_t::kib, probe_t::numa, true},
+    }};
+
+    inline const key_info_t &info_fn(key_t k)
+    {
+        return key_table[(size_t)k];
+    }
+
+    inline bool key_from_name_fn(std::string_view name, key_t &out)
+    {
+        for (size_t i = 0; i < key_count; ++i)
+        {
+            if (name == key_table[i].name)
+            {
+                out = (key_t)i;
+                return true;
+            }
+        }
+        // aliases
+        if (name == "hostname")
+            out = key_t::host;
+        else if (name == "shell")
+            out = key_t::sh;
+        else if (name == "gpus")
+            out = key_t::gpu;
+        else if (name == "numa")
+            out = key_t::numa_node;
+        else
+            return false;
+        return true;
+    }
+
+    // 1234 -> "1.234", trailing zeros dropped
+    inline std::string milli_text_fn(long long n)
+    {
+        std::string s;
+        numfmt_ns::append_milli_fn(s, n);
+        return s;
+    }
+
+    struct value_t
+    {
+            kind_t kind = kind_t::text;
+            std::string text;
+            long long num = 0;
+    };
+
+    // One plugin key's value, by registry slot
+    struct plugin_val_t
+    {
+            std::string text;
+            long long num = 0;
+            bool set = false;
+            bool count = false; // declared MFETCH_COUNT and text is an integer
+            bool done = false;
+            std::chrono::steady_clock::time_point probed_at{};
+    };
+
+    // Lazily probed, cached facts. Each probe runs at most once per store.
+    class store_t
+    {
+            sysinfo_t &sys;
+            std::array<std::vector<value_t>, key_count> vals;
+            std::bitset<probe_count> done;
+            std::array<std::chrono::steady_clock::time_point, probe_count> probed_at{};
+            std::vector<plugin_val_t> plugin_vals;
+
+            // plugin buffers start this big; a value is the buffer itself, trimmed to len
+            static constexpr size_t plugin_cap = 1024;
+
+            // Runs one plugin and fills every interned slot that belongs to it
+            void run_plugin_fn(const std::string &plugin)
+            {
+                auto &reg = plugin_ns::registry_t::instance_fn();
+                auto &src = sys.source_fn();
+                size_t n = reg.slot_count_fn();
+                if (plugin_vals.size() < n)
+                    plugin_vals.resize(n);
+
+                auto now = std::chrono::steady_clock::now();
+                std::vector<size_t> mine;
+                for (size_t s = 0; s < n; ++s)
+                {
+                    if (reg.slot_fn(s).plugin == plugin)
+                    {
+                        mine.push_back(s);
+                        plugin_vals[s] = {};
+                        plugin_vals[s].done = true;
+                        plugin_vals[s].probed_at = now;
+                    }
+                }
+
+                // MFETCH_COUNT values are recorded with a "<plugin.key>:count" marker
+                // next to them, so a replay types them without loading the plugin
+                if (src.mode_fn() == source_ns::mode_t::replay)
+                {
+                    for (size_t s : mine)
+                    {
+                        auto &pv = plugin_vals[s];
+                        std::string marker;
+                        pv.set = src.plugin_value_fn(reg.slot_fn(s).full, pv.text);
+                        if (pv.set && src.plugin_value_fn(reg.slot_fn(s).full + ":count", marker))
+                            count_value_fn(pv);
+                    }
+                    return;
+                }
+                // like commands, plugins describe the running system
+                if (!src.root_fn().empty())
+                    return;
+
+                const mfetch_plugin *api = reg.load_fn(plugin);
+                if (api)
+                {
+                    std::string detail = plugin + " (" + plugin_ns::cost_name_fn(api->cost) + ")";
+                    MFETCH_SCOPE_D("probe:plugin", detail.c_str());
+                    std::vector<std::string> bufs(api->key_count, std::string(plugin_cap, '\0'));
+                    std::vector<mfetch_value> out(api->key_count);
+                    for (uint32_t k = 0; k < api->key_count; ++k)
+                        out[k] = {bufs[k].data(), plugin_cap, 0};
+
+                    if (api->probe(out.data(), api->user) == 0)
+                    {
+                        for (size_t s : mine)
+                        {
+                            const std::string &key = reg.slot_fn(s).key;
+                            for (uint32_t k = 0; k < api->key_count; ++k)
+                            {
+                                if (!api->keys[k].name || key != api->keys[k].name || out[k].len == 0)
+                                    continue;
+                                bufs[k].resize(std::min(out[k].len, plugin_cap));
+                                plugin_vals[s].text = std::move(bufs[k]);
+                                plugin_vals[s].set = true;
+                                if (api->keys[k].kind == MFETCH_COUNT)
+                                    count_value_fn(plugin_vals[s]);
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                for (size_t s : mine)
+                {
+                    src.record_plugin_fn(reg.slot_fn(s).full, plugin_vals[s].set ? std::optional<std::string>(plugin_vals[s].text) : std::nullopt);
+                    if (plugin_vals[s].count)
+                        src.record_plugin_fn(reg.slot_fn(s).full + ":count", std::string("1"));
+                }
+            }
+
+            // A count whose text is not a plain integer stays text
+            static void count_value_fn(plugin_val_t &pv)
+            {
+                const char *b = pv.text.data();
+                const char *e = b + pv.text.size();
+                auto r = std::from_chars(b, e, pv.num);
+                pv.count = r.ec == std::errc() && r.ptr == e;
+            }
+
+            void set_fn(key_t k, std::string text)
+            {
+                vals[(size_t)k].push_back({kind_t::text, std::move(text), 0});
+            }
+
+            void set_num_fn(key_t k, long long n)
+            {
+                kind_t kind = info_fn(k).kind;
+                std::string text;
+                if (kind == kind_t::milli)
+                    numfmt_ns::append_milli_fn(text, n);
+                else
+                    numfmt_ns::append_int_fn(text, n);
+                vals[(size_t)k].push_back({kind, std::move(text), n});
+            }
+
+            void run_probe_fn(probe_t p)
+            {
+                MFETCH_SCOPE(probe_names[(size_t)p]);
+                switch (p)
+                {
+                    case probe_t::host:
+                        set_fn(key_t::host, sys.get_hostname_fn());
+                        break;
+                    case probe_t::user:
+                        set_fn(key_t::user, sys.get_username_fn());
+                        break;
+                    case probe_t::kernel:
+                        set_fn(key_t::kernel_name, sys.get_kernel_name_fn());
+                        set_fn(key_t::kernel, sys.get_kernel_fn());
+                        break;
+                    case probe_t::os:
+                        set_fn(key_t::os, sys.get_os_fn());
+                        break;
+                    case probe_t::cpu:
+                        set_fn(key_t::cpu, sys.get_cpu_model_fn());
+                        break;
+                    case probe_t::sh:
+                        set_fn(key_t::sh, sys.get_shell_fn());
+                        break;
+                    case probe_t::term:
+                        set_fn(key_t::term, sys.get_term_fn());
+                        break;
+                    case probe_t::proc:
+                    {
+                        std::string n = sys.get_proc_count_fn();
+                        set_num_fn(key_t::proc, std::atoll(n.c_str()));
+                        break;
+                    }
+                    case probe_t::wm:
+                        set_fn(key_t::wm, sys.get_wm_fn());
+                        break;
+                    case probe_t::de:
+                        set_fn(key_t::de, sys.get_de_fn());
+                        break;
+                    case probe_t::mem:
+                    {
+                        auto mem = sys.get_mem_fn();
+                        set_num_fn(key_t::ram_used, mem.used);
+                        set_num_fn(key_t::ram_total, mem.total);
+                        set_num_fn(key_t::swap_used, mem.swap_used);
+                        set_num_fn(key_t::swap_total, mem.swap_total);
+                        break;
+                    }
+                    case probe_t::gpu:
+                        for (auto &g : sys.get_gpus_fn())
+                            set_fn(key_t::gpu, std::move(g.model));
+                        break;
+                    case probe_t::pkgs:
+                    {
+                        std::string s;
+                        for (auto &p : sys.get_pkgs_fn())
+                        {
+                            if (!s.empty())
+                                s += ", ";
+                            numfmt_ns::append_int_fn(s, p.count);
+                            s += " " + p.manager;
+                            set_num_fn(key_t::pkg_count, p.count);
+                            set_fn(key_t::pkg_manager, std::move(p.manager));
+                        }
+                        set_fn(key_t::pkgs, s.empty() ? "0" : s);
+                        break;
+                    }
+                    case probe_t::mounts:
+                        for (auto &m : sys.get_mounts_fn())
+                        {
+                            // partition number: trailing digits of the device node
+                            size_t d = m.device.size();
+                            while (d > 0 && std::isdigit((unsigned char)m.device[d - 1]))
+                                --d;
+                            set_fn(key_t::mnt_part, m.device.substr(d));
+                            set_fn(key_t::mnt_point, std::move(m.point));
+                            set_fn(key_t::mnt_dev, std::move(m.device));
+                            set_num_fn(key_t::mnt_used, m.used);
+                            set_num_fn(key_t::mnt_total, m.total);
+                        }
+                        break;
+                    case probe_t::load:
+                    {
+                        auto l = sys.get_load_fn();
+                        set_num_fn(key_t::load1, l.one);
+                        set_num_fn(key_t::load5, l.five);
+                        set_num_fn(key_t::load15, l.fifteen);
+                        break;
+                    }
+                    case probe_t::uptime:
+                        set_num_fn(key_t::uptime, sys.get_uptime_fn());
+                        break;
+                    case probe_t::temps:
+                        for (auto &t : sys.get_temps_fn())
+                        {
+                            set_fn(key_t::temp_zone, std::move(t.zone));
+                            set_num_fn(key_t::temp, t.milli_c);
+                        }
+                        break;
+                    case probe_t::topology:
+                    {
+                        auto t = sys.get_topology_fn();
+                        // "2 sockets, 64 cores, 128 threads, SMT on"
+                        std::string sum;
+                        if (t.sockets)
+                            sum += std::to_string(t.sockets) + (t.sockets == 1 ? " socket, " : " sockets, ");
+                        if (t.cores)
+                            sum += std::to_string(t.cores) + (t.cores == 1 ? " core, " : " cores, ");
+                        sum += std::to_string(t.threads) + (t.threads == 1 ? " thread" : " threads");
+                        sum += ", SMT " + t.smt;
+                        set_fn(key_t::topology, std::move(sum));
+                        set_num_fn(key_t::sockets, t.sockets);
+                        set_num_fn(key_t::cores, t.cores);
+                        set_num_fn(key_t::threads, t.threads);
+                        set_fn(key_t::smt, std::move(t.smt));
+                        set_fn(key_t::cpus_online, std::move(t.online));
+                        set_fn(key_t::cpus_isolated, t.isolated.empty() ? "none" : std::move(t.isolated));
+
+                        // "L1d 48K x64, L1i 32K x64, L2 2048K x64, L3 262144K x2"
+                        std::string cs;
+                        for (const auto &c : t.caches)
+                        {
+                            if (!cs.empty())
+                                cs += ", ";
+                            cs += c.name + " " + c.size;
+                            if (c.instances > 1)
+                                cs += " x" + std::to_string(c.instances);
+
+                            if (c.name == "L1d")
+                                set_num_fn(key_t::cache_l1d, c.kib);
+                            else if (c.name == "L1i")
+                                set_num_fn(key_t::cache_l1i, c.kib);
+                            else if (c.name == "L2")
+                                set_num_fn(key_t::cache_l2, c.kib);
+                            else if (c.name == "L3")
+                                set_num_fn(key_t::cache_l3, c.kib);
+                        }
+                        if (!cs.empty())
+                            set_fn(key_t::caches, std::move(cs));
+                        break;
+                    }
+                    case probe_t::numa:
+                        for (auto &n : sys.get_numa_fn())
+                        {
+                            set_num_fn(key_t::numa_node, n.id);
+                            set_fn(key_t::numa_cpus, std::move(n.cpus));
+                            set_num_fn(key_t::numa_mem_used, n.mem_used);
+                            set_num_fn(key_t::numa_mem_total, n.mem_total);
+                        }
+                        break;
+                    case probe_t::count_:
+                        break;
+                }
+            }
+
+            void ensure_fn(key_t k)
+            {
+                size_t p = (size_t)info_fn(k).probe;
+                if (!done[p])
+                {
+                    done[p] = true;
+                    probed_at[p] = std::chrono::steady_clock::now();
+                    run_probe_fn((probe_t)p);
+                }
+            }
+
+            void drop_fn(size_t p)
+            {
+                done[p] = false;
+                for (size_t k = 0; k < key_count; ++k)
+                    if ((size_t)key_table[k].probe == p)
+                        vals[k].clear();
+            }
+
+        public:
+            explicit store_t(sysinfo_t &s) : sys(s)
+            {
+            }
+
+            // Plugin value for a registry slot, nullptr if the plugin gave none
+            const std::string *plugin_fn(size_t slot)
+            {
+                const plugin_val_t *v = plugin_value_fn(slot);
+                return v ? &v->text : nullptr;
+            }
+
+            // The same with its type, for typed output; nullptr if the plugin gave none
+            const plugin_val_t *plugin_value_fn(size_t slot)
+            {
+                if (slot >= plugin_vals.size() || !plugin_vals[slot].done)
+                    run_plugin_fn(plugin_ns::registry_t::instance_fn().slot_fn(slot).plugin);
+                const auto &v = plugin_vals[slot];
+                return v.set ? &v : nullptr;
+            }
+
+            // --record, --all and --prometheus: every key of every installed plugin
+            void probe_installed_plugins_fn()
+            {
+                auto &reg = plugin_ns::registry_t::instance_fn();
+                for (const auto &name : reg.installed_fn())
+                {
+                    const mfetch_plugin *api = reg.load_fn(name);
+                    if (!api || !api->key_count)
+                        continue;
+                    for (uint32_t k = 0; k < api->key_count; ++k)
+                    {
+                        if (api->keys[k].name)
+                            reg.intern_fn(name + "." + api->keys[k].name);
+                    }
+                    run_plugin_fn(name);
+                }
+            }
+
+            sysinfo_t &sys_fn()
+            {
+                return sys;
+            }
+
+            // For long-running modes: live probes run again on next use,
+            // slow ones once they are older than slow_ttl, fixed ones never
+            void refresh_fn(std::chrono::seconds slow_ttl = std::chrono::minutes(5))
+            {
+                auto now = std::chrono::steady_clock::now();
+                for (size_t p = 0; p < probe_count; ++p)
+                {
+                    if (!done[p])
+                        continue;
+                    volatility_t v = probe_volatility[p];
+                    if (v == volatility_t::live || (v == volatility_t::slow && now - probed_at[p] >= slow_ttl))
+                        drop_fn(p);
+                }
+
+                auto &reg = plugin_ns::registry_t::instance_fn();
+                for (size_t s = 0; s < plugin_vals.size(); ++s)
+                {
+                    auto &pv = plugin_vals[s];
+                    if (!pv.done)
+                        continue;
+                    const mfetch_plugin *api = reg.find_fn(reg.slot_fn(s).plugin);
+                    uint8_t v = api ? api->volatility : (uint8_t)MFETCH_FIXED;
+                    if (v == MFETCH_LIVE || (v == MFETCH_SLOW && now - pv.probed_at >= slow_ttl))
+                        pv.done = false;
+                }
+            }
+
+            size_t count_fn(key_t k)
+            {
+                ensure_fn(k);
+                return vals[(size_t)k].size();
+            }
+
+            // nullptr when the probe produced nothing for this index
+            const value_t *get_fn(key_t k, size_t idx = 0)
+            {
+                ensure_fn(k);
+                const auto &v = vals[(size_t)k];
+                return idx < v.size() ? &v[idx] : nullptr;
+            }
+
+            // Takes probe p's values from another store instead of probing,
+            // for facts that are the same across stores (host cpu in every container)
+            void share_fn(store_t &from, probe_t p)
+            {
+                size_t pi = (size_t)p;
+                for (size_t k = 0; k < key_count; ++k)
+                {
+                    if ((size_t)key_table[k].probe != pi)
+                        continue;
+                    from.ensure_fn((key_t)k);
+                    vals[k] = from.vals[k];
+                }
+                done[pi] = true;
+                probed_at[pi] = from.probed_at[pi];
+            }
+
+            // Probe p's values from outside (the --get disk cache); p is then not run.
+            // Values for keys of other probes are dropped.
+            void adopt_fn(probe_t p, std::vector<std::pair<key_t, value_t>> values)
+            {
+                drop_fn((size_t)p);
+                for (auto &kv : values)
+                    if (info_fn(kv.first).probe == p)
+                        vals[(size_t)kv.first].push_back(std::move(kv.second));
+                done[(size_t)p] = true;
+                probed_at[(size_t)p] = std::chrono::steady_clock::now();
+            }
+    };
+} // namespace facts_ns
@@ -0,0 +1,604 @@
+#pragma once
+
+#include "facts.hpp"
+#include "numfmt.hpp"
+#include "util.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// Format templates are compiled once into a flat op list and executed
+// straight into the output buffer.
+//
+//   [key -filter -filter=arg -color <style>]   dsl placeholder
+//   {key}                                      legacy placeholder (old lowercasing rules)
+//   [plugin.key] / {plugin.key}                value from ~/.config/mfetch/plugins/plugin.so
+//   [n]                                        index of the expanded row (gpus, mnts)
+//   [unit]                                     suffix of the unit the last value was shown in
+//   [used -round=2 -unit=auto]                 byte values: decimals, unit (b kib mib gib tib kb mb gb tb auto auto-si)
+//   [used -percent] / [x -percent=y]           value as a percentage of its total / of y
+//   [0]                                        tree depth of the row
+namespace format_ns
+{
+    using facts_ns::key_t;
+    using facts_ns::kind_t;
+
+    enum class op_t : uint8_t
+    {
+        lit,         // pool[off, off + len)
+        val,         // key, off = fixed index + 1 (0 = row index), prec
+        legacy,      // {key}
+        index,       // row index
+        unit,        // display unit suffix
+        sgr,         // precompiled escape in pool
+        reset,       // \033[0m
+        lower,       // filters below work on the output of the last value op
+        upper,
+        no_brand,
+        no_speed,
+        no_platform,
+        plugin,  // key = plugin registry slot
+        percent, // key / len, off = fixed index + 1, prec
+    };
+
+    struct insn_t
+    {
+            op_t op;
+            uint8_t prec = 0xff; // 0xff = default rounding
+            uint8_t unit = 0xff; // -unit= override: scale | 0x10 if decimal, 0xff = the display unit
+            uint16_t key = 0;
+            uint32_t off = 0;
+            uint32_t len = 0;
+    };
+
+    struct program_t
+    {
+            std::vector<insn_t> code;
+            std::string pool;
+            int depth = -1;    // [N] marker, -1 if absent
+            int iter_key = -1; // indexed key that drives row expansion, -1 = single row
+    };
+
+    using unit_t = numfmt_ns::unit_t;
+
+    // [display] unit; unknown names warn and fall back to GiB
+    inline unit_t parse_unit_fn(const std::string &s)
+    {
+        unit_t u;
+        if (!numfmt_ns::parse_unit_fn(s, u))
+            std::cerr << "mfetch: unknown unit '" << s << "', using GiB\n";
+        return u;
+    }
+
+    // -- compiler --
+
+    namespace detail
+    {
+        inline bool is_digits_fn(std::string_view s)
+        {
+            if (s.empty())
+                return false;
+            for (char c : s)
+                if (!std::isdigit((unsigned char)c))
+                    return false;
+            return true;
+        }
+
+        struct scoped_name_t
+        {
+                std::string_view scope;
+                std::string_view name;
+                key_t key;
+        };
+
+        // Scoped names: "used" means ram_used inside the ram row, mnt_used inside mnts
+        inline constexpr scoped_name_t scoped_names[] = {
+            {"ram", "used", key_t::ram_used},
+            {"ram", "all", key_t::ram_total},
+            {"ram", "total", key_t::ram_total},
+            {"swap", "used", key_t::swap_used},
+            {"swap", "all", key_t::swap_total},
+            {"swap", "total", key_t::swap_total},
+            {"mnts", "used", key_t::mnt_used},
+            {"mnts", "all", key_t::mnt_total},
+            {"mnts", "total", key_t::mnt_total},
+            {"mnts", "mount-point", key_t::mnt_point},
+            {"mnts", "partition", key_t::mnt_part},
+            {"mnts", "device", key_t::mnt_dev},
+            {"kernel", "k", key_t::kernel_name},
+            {"kernel", "v", key_t::kernel},
+        };
+
+        inline bool scoped_key_fn(std::string_view scope, std::string_view name, key_t &k, uint32_t &fixed)
+        {
+            if (scope == "memory")
+                scope = "ram";
+            else if (scope == "mnt" || scope == "disk" || scope == "disks")
+                scope = "mnts";
+
+            for (const auto &s : scoped_names)
+            {
+                if (s.scope == scope && s.name == name)
+                {
+                    k = s.key;
+                    return true;
+                }
+            }
+
+            // n-pkg1 / n-pkgs1 / pkgmgr1: fixed package slots, 1-based
+            auto slot = [&](std::string_view prefix, key_t key)
+            {
+                if (name.size() > prefix.size() && name.substr(0, prefix.size()) == prefix && is_digits_fn(name.substr(prefix.size())))
+                {
+                    uint32_t n = (uint32_t)std::strtoul(std::string(name.substr(prefix.size())).c_str(), nullptr, 10);
+                    if (n > 0)
+                    {
+                        k = key;
+                        fixed = n;
+                        return true;
+                    }
+                }
+                return false;
+            };
+            return slot("n-pkgs", key_t::pkg_count) || slot("n-pkg", key_t::pkg_count) || slot("pkgmgr", key_t::pkg_manager);
+        }
+
+        inline void push_lit_fn(program_t &p, std::string_view s)
+        {
+            if (s.empty())
+                return;
+            // merge adjacent literals
+            if (!p.code.empty() && p.code.back().op == op_t::lit && p.code.back().off + p.code.back().len == p.pool.size())
+                p.code.back().len += (uint32_t)s.size();
+            else
+            {
+                insn_t i{op_t::lit};
+                i.off = (uint32_t)p.pool.size();
+                i.len = (uint32_t)s.size();
+                p.code.push_back(i);
+            }
+            p.pool.append(s);
+        }
+
+        // ram_used -> ram_total, for -percent without an argument
+        inline bool total_of_fn(key_t k, key_t &total)
+        {
+            switch (k)
+            {
+                case key_t::ram_used:
+                    total = key_t::ram_total;
+                    return true;
+                case key_t::swap_used:
+                    total = key_t::swap_total;
+                    return true;
+                case key_t::mnt_used:
+                    total = key_t::mnt_total;
+                    return true;
+                case key_t::numa_mem_used:
+                    total = key_t::numa_mem_total;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        inline void push_key_fn(program_t &p, op_t op, key_t k, uint32_t fixed, uint8_t prec, uint8_t unit = 0xff)
+        {
+            insn_t i{op};
+            i.key = (uint16_t)k;
+            i.off = fixed;
+            i.prec = prec;
+            i.unit = unit;
+            p.code.push_back(i);
+            if (fixed == 0 && facts_ns::info_fn(k).indexed && p.iter_key < 0)
+                p.iter_key = (int)k;
+        }
+
+        // plugin.key -> plugin op; the plugin itself is loaded on first use
+        inline bool push_plugin_fn(program_t &p, std::string_view name)
+        {
+            int slot = plugin_ns::registry_t::instance_fn().intern_fn(name);
+            if (slot < 0)
+                return false;
+            insn_t i{op_t::plugin};
+            i.key = (uint16_t)slot;
+            p.code.push_back(i);
+            return true;
+        }
+
+        inline void warn_fn(std::string_view scope, const std::string &msg)
+        {
+            std::cerr << "mfetch: format '" << scope << "': " << msg << "\n";
+        }
+
+        inline void compile_placeholder_fn(program_t &p, std::string_view scope, std::string_view body)
+        {
+            std::vector<std::string_view> tok;
+            size_t i = 0;
+            while (i < body.size())
+            {
+                while (i < body.size() && std::isspace((unsigned char)body[i]))
+                    ++i;
+                size_t s = i;
+                while (i < body.size() && !std::isspace((unsigned char)body[i]))
+                    ++i;
+                if (i > s)
+                    tok.push_back(body.substr(s, i - s));
+            }
+            if (tok.empty())
+                return push_lit_fn(p, "[]");
+
+            std::string_view name = tok[0];
+            if (is_digits_fn(name) && tok.size() == 1)
+            {
+                p.depth = std::atoi(std::string(name).c_str());
+                return;
+            }
+
+            // filters first, they decide what the value op looks like
+            std::string style;
+            uint8_t prec = 0xff;
+            uint8_t unit = 0xff;
+            bool percent = false;
+            std::string_view percent_of; // "" = the value's own total
+            std::vector<op_t> post;
+            for (size_t t = 1; t < tok.size(); ++t)
+            {
+                std::string_view f = tok[t];
+                if (f == "-lower")
+                    post.push_back(op_t::lower);
+                else if (f == "-upper")
+                    post.push_back(op_t::upper);
+                else if (f == "-no-brand")
+                    post.push_back(op_t::no_brand);
+                else if (f == "-no-speed")
+                    post.push_back(op_t::no_speed);
+                else if (f == "-no-platform-tokens")
+                    post.push_back(op_t::no_platform);
+                else if (f.substr(0, 7) == "-round=")
+                    prec = (uint8_t)std::min(9, std::max(0, std::atoi(std::string(f.substr(7)).c_str())));
+                else if (f.substr(0, 6) == "-unit=")
+                {
+                    numfmt_ns::unit_t u;
+                    if (numfmt_ns::parse_unit_fn(f.substr(6), u) && u.explicit_)
+                        unit = (uint8_t)((uint8_t)u.scale | (u.decimal ? 0x10 : 0));
+                    else
+                        warn_fn(scope, "unknown unit '" + std::string(f.substr(6)) + "'");
+                }
+                else if (f == "-percent" || f.substr(0, 9) == "-percent=")
+                {
+                    percent = true;
+                    percent_of = f.size() > 9 ? f.substr(9) : std::string_view();
+                }
+                else if (f == "-color")
+                {
+                    // style runs until the next filter
+                    while (t + 1 < tok.size() && tok[t + 1][0] != '-')
+                    {
+                        if (!style.empty())
+                            style += ' ';
+                        style += tok[++t];
+                    }
+                }
+                else
+                    warn_fn(scope, "unknown filter '" + std::string(f) + "'");
+            }
+
+            std::string sgr = util_ns::sgr_fn(style);
+            if (!sgr.empty())
+            {
+                insn_t s{op_t::sgr};
+                s.off = (uint32_t)p.pool.size();
+                s.len = (uint32_t)sgr.size();
+                p.pool += sgr;
+                p.code.push_back(s);
+            }
+
+            key_t k;
+            uint32_t fixed = 0;
+            if (name == "n")
+                p.code.push_back({op_t::index});
+            else if (name == "unit")
+                p.code.push_back({op_t::unit});
+            else if (scoped_key_fn(scope, name, k, fixed) || facts_ns::key_from_name_fn(name, k))
+            {
+                key_t total;
+                uint32_t unused = 0;
+                bool have_total = percent_of.empty() ? total_of_fn(k, total)
+                                                     : scoped_key_fn(scope, percent_of, total, unused) || facts_ns::key_from_name_fn(percent_of, total);
+                if (percent && !have_total)
+                    warn_fn(scope, "-percent: no total for '" + std::string(name) + "'");
+                push_key_fn(p, percent && have_total ? op_t::percent : op_t::val, k, fixed, prec, unit);
+                if (percent && have_total)
+                    p.code.back().len = (uint32_t)total;
+            }
+            else if (!push_plugin_fn(p, name))
+            {
+                warn_fn(scope, "unknown key '" + std::string(name) + "'");
+                push_lit_fn(p, "unknown");
+            }
+
+            for (op_t o : post)
+                p.code.push_back({o});
+            if (!sgr.empty())
+                p.code.push_back({op_t::reset});
+        }
+    } // namespace detail
+
+    // scope is the module type / [format] key the template belongs to
+    inline program_t compile_fn(std::string_view src, std::string_view scope)
+    {
+        program_t p;
+        size_t lit_start = 0;
+        size_t i = 0;
+        while (i < src.size())
+        {
+            char c = src[i];
+            if (c != '[' && c != '{')
+            {
+                ++i;
+                continue;
+            }
+
+            size_t end = src.find(c == '[' ? ']' : '}', i + 1);
+            if (end == std::string_view::npos)
+                break;
+
+            detail::push_lit_fn(p, src.substr(lit_start, i - lit_start));
+            std::string_view body = src.substr(i + 1, end - i - 1);
+            if (c == '[')
+                detail::compile_placeholder_fn(p, scope, body);
+            else
+            {
+                key_t k;
+                if (facts_ns::key_from_name_fn(body, k))
+                    detail::push_key_fn(p, op_t::legacy, k, 0, 0xff);
+                else if (!detail::push_plugin_fn(p, body))
+                    detail::push_lit_fn(p, "unknown");
+            }
+            i = lit_start = end + 1;
+        }
+        detail::push_lit_fn(p, src.substr(lit_start));
+        return p;
+    }
+
+    // Marks every fact key the program reads
+    inline void collect_keys_fn(const program_t &p, std::bitset<facts_ns::key_count> &keys)
+    {
+        for (const auto &i : p.code)
+        {
+            if (i.op == op_t::val || i.op == op_t::legacy || i.op == op_t::percent)
+                keys.set(i.key);
+            if (i.op == op_t::percent)
+                keys.set(i.len);
+        }
+    }
+
+    // Registry slots of the plugin keys p uses, each once
+    inline void collect_plugins_fn(const program_t &p, std::vector<size_t> &slots)
+    {
+        for (const auto &i : p.code)
+        {
+            if (i.op == op_t::plugin && std::find(slots.begin(), slots.end(), (size_t)i.key) == slots.end())
+                slots.push_back(i.key);
+        }
+    }
+
+    // -- executor --
+
+    struct run_ctx_t
+    {
+            facts_ns::store_t &facts;
+            const unit_t &unit;
+            size_t index = 0;
+            unit_t last{};          // unit of the last byte value, for [unit]
+            bool have_last = false;
+    };
+
+    namespace detail
+    {
+        inline bool ieq_fn(std::string_view a, std::string_view b)
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); ++i)
+                if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+                    return false;
+            return true;
+        }
+
+        inline bool ends_with_i_fn(std::string_view s, std::string_view suf)
+        {
+            return s.size() >= suf.size() && ieq_fn(s.substr(s.size() - suf.size()), suf);
+        }
+
+        inline bool is_speed_fn(std::string_view t)
+        {
+            if (t == "@" || ieq_fn(t, "ghz") || ieq_fn(t, "mhz"))
+                return true;
+            bool dot = t.find('.') != std::string_view::npos;
+            bool digit = false;
+            for (char c : t)
+                digit |= (bool)std::isdigit((unsigned char)c);
+            return dot && digit && (ends_with_i_fn(t, "ghz") || ends_with_i_fn(t, "mhz") || std::isdigit((unsigned char)t.back()));
+        }
+
+        inline bool in_list_fn(std::string_view t, std::initializer_list<std::string_view> list)
+        {
+            for (auto l : list)
+                if (ieq_fn(t, l))
+                    return true;
+            return false;
+        }
+
+        // Drops matching tokens from out[mark, end) in place and collapses spaces
+        template <typename Pred>
+        inline void drop_tokens_fn(std::string &out, size_t mark, Pred drop)
+        {
+            // vendor marks glued onto words go first: Intel(R) -> Intel
+            for (std::string_view m : {"(R)", "(TM)", "(r)", "(tm)"})
+            {
+                size_t pos;
+                while ((pos = out.find(m, mark)) != std::string::npos)
+                    out.erase(pos, m.size());
+            }
+
+            size_t w = mark;
+            size_t r = mark;
+            size_t n = out.size();
+            while (r < n)
+            {
+                while (r < n && out[r] == ' ')
+                    ++r;
+                size_t s = r;
+                while (r < n && out[r] != ' ')
+                    ++r;
+                if (r == s)
+                    break;
+                std::string_view t(out.data() + s, r - s);
+                if (drop(t))
+                    continue;
+                if (w > mark)
+                    out[w++] = ' ';
+                std::memmove(&out[w], &out[s], r - s);
+                w += r - s;
+            }
+            out.resize(w);
+        }
+
+        // -unit= override, else the display unit
+        inline unit_t unit_of_fn(const insn_t &i, const unit_t &display)
+        {
+            if (i.unit == 0xff)
+                return display;
+            unit_t u;
+            u.scale = (numfmt_ns::scale_t)(i.unit & 0x0f);
+            u.decimal = i.unit & 0x10;
+            u.explicit_ = true;
+            return u;
+        }
+
+        // pre-dsl behaviour of {key}
+        inline void append_legacy_fn(std::string &out, const facts_ns::value_t *v, key_t k, const unit_t &unit)
+        {
+            if (!v)
+            {
+                out += "unknown";
+                return;
+            }
+            if (k == key_t::cpu)
+                out += sysinfo_ns::sysinfo_t::clean_cpu_fn(v->text);
+            else if (k == key_t::gpu)
+                out += sysinfo_ns::sysinfo_t::clean_gpu_fn(v->text);
+            else if (v->kind == kind_t::kib)
+            {
+                // the old "5.9g" unless the config picked a unit
+                numfmt_ns::unit_t u = unit.explicit_ ? unit : numfmt_ns::legacy_unit;
+                numfmt_ns::scale_t s = numfmt_ns::append_bytes_fn(out, v->num, u);
+                if (!u.terse)
+                    out += ' ';
+                out += numfmt_ns::suffix_fn(u, s);
+            }
+            else
+                out += v->text;
+        }
+    } // namespace detail
+
+    inline void run_fn(const program_t &p, run_ctx_t &ctx, std::string &out)
+    {
+        size_t mark = out.size();
+        for (const auto &i : p.code)
+        {
+            switch (i.op)
+            {
+                case op_t::lit:
+                case op_t::sgr:
+                    out.append(p.pool, i.off, i.len);
+                    break;
+                case op_t::reset:
+                    out += "\033[0m";
+                    break;
+                case op_t::index:
+                    mark = out.size();
+                    out += std::to_string(ctx.index);
+                    break;
+                case op_t::unit:
+                    mark = out.size();
+                    out += ctx.have_last ? numfmt_ns::suffix_fn(ctx.last, ctx.last.scale) : numfmt_ns::suffix_fn(ctx.unit, ctx.unit.scale);
+                    break;
+                case op_t::val:
+                {
+                    mark = out.size();
+                    const auto *v = ctx.facts.get_fn((key_t)i.key, i.off ? i.off - 1 : ctx.index);
+                    if (!v)
+                        out += "unknown";
+                    else if (v->kind == kind_t::kib)
+                    {
+                        ctx.last = detail::unit_of_fn(i, ctx.unit);
+                        ctx.last.scale = numfmt_ns::append_bytes_fn(out, v->num, ctx.last, i.prec == 0xff ? -1 : i.prec);
+                        ctx.have_last = true;
+                    }
+                    else
+                        out += v->text;
+                    break;
+                }
+                case op_t::percent:
+                {
+                    mark = out.size();
+                    size_t idx = i.off ? i.off - 1 : ctx.index;
+                    const auto *part = ctx.facts.get_fn((key_t)i.key, idx);
+                    const auto *whole = ctx.facts.get_fn((key_t)i.len, facts_ns::info_fn((key_t)i.len).indexed ? idx : 0);
+                    if (!part || !whole)
+                        out += "unknown";
+                    else
+                        numfmt_ns::append_percent_fn(out, part->num, whole->num, i.prec == 0xff ? -1 : i.prec);
+                    break;
+                }
+                case op_t::legacy:
+                {
+                    mark = out.size();
+                    key_t k = (key_t)i.key;
+                    detail::append_legacy_fn(out, ctx.facts.get_fn(k, ctx.index), k, ctx.unit);
+                    // the old renderer lowercased most fields unconditionally
+                    if (k == key_t::host || k == key_t::user || k == key_t::kernel || k == key_t::os || k == key_t::cpu || k == key_t::sh || k == key_t::term || k == key_t::gpu)
+                        std::transform(out.begin() + mark, out.end(), out.begin() + mark, [](unsigned char c)
+                                       { return std::tolower(c); });
+                    break;
+                }
+                case op_t::plugin:
+                {
+                    mark = out.size();
+                    const std::string *v = ctx.facts.plugin_fn(i.key);
+                    out += v ? *v : "unknown";
+                    break;
+                }
+                case op_t::lower:
+                    std::transform(out.begin() + mark, out.end(), out.begin() + mark, [](unsigned char c)
+                                   { return std::tolower(c); });
+                    break;
+                case op_t::upper:
+                    std::transform(out.begin() + mark, out.end(), out.begin() + mark, [](unsigned char c)
+                                   { return std::toupper(c); });
+                    break;
+                case op_t::no_brand:
+                    detail::drop_tokens_fn(out, mark, [](std::string_view t)
+                                           { return detail::in_list_fn(t, {"intel", "amd", "nvidia", "corporation", "corp.", "inc", "inc.", "core", "cpu", "processor", "geforce", "ati", "amd/ati"}); });
+                    break;
+                case op_t::no_speed:
+                    detail::drop_tokens_fn(out, mark, detail::is_speed_fn);
+                    break;
+                case op_t::no_platform:
+                    detail::drop_tokens_fn(out, mark, [](std::string_view t)
+                                           { return detail::in_list_fn(t, {"gnu/linux", "linux", "gnu", "x86_64", "amd64", "aarch64", "arm64", "i686"}); });
+                    break;
+            }
+        }
+    }
+} // namespace format_ns
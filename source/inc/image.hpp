@@ -0,0 +1,397 @@
+#pragma once
+
+#include "util.hpp"
+#include "layout.hpp"
+#include "timing.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+#include <fcntl.h>
+
+// [image] logos through terminal graphics.
+//
+//   kitty: PNG is passed through untouched (f=100), PPM is sent as raw RGB;
+//          the terminal scales either to the cell box.
+//   sixel: PPM only, scaled to the box in pixels and quantised to a 6x6x6 cube.
+//
+// Encoded payloads are cached in $XDG_CACHE_HOME/mfetch (~/.cache/mfetch),
+// keyed by a hash of the source bytes, the cell box, the cell size in pixels
+// and the protocol, so a warm run reads the source, hashes it and writes the blob.
+namespace image_ns
+{
+    enum class protocol_t
+    {
+        none,
+        kitty,
+        sixel,
+    };
+
+    inline const char *protocol_name_fn(protocol_t p)
+    {
+        return p == protocol_t::kitty ? "kitty" : p == protocol_t::sixel ? "sixel"
+                                                                         : "none";
+    }
+
+    // From the environment; only when stdout is a terminal
+    inline protocol_t detect_fn()
+    {
+        if (!isatty(STDOUT_FILENO))
+            return protocol_t::none;
+
+        auto env = [](const char *n) -> std::string
+        {
+            const char *v = std::getenv(n);
+            return v ? v : "";
+        };
+        std::string term = env("TERM");
+        std::string prog = env("TERM_PROGRAM");
+
+        if (!env("KITTY_WINDOW_ID").empty() || term == "xterm-kitty" || term == "xterm-ghostty" || prog == "ghostty" || prog == "WezTerm")
+            return protocol_t::kitty;
+        if (term.rfind("foot", 0) == 0 || term.find("mlterm") != std::string::npos || term.find("contour") != std::string::npos || prog == "iTerm.app")
+            return protocol_t::sixel;
+        return protocol_t::none;
+    }
+
+    // "auto" detects, anything unknown is none
+    inline protocol_t parse_protocol_fn(const std::string &s)
+    {
+        if (s.empty() || s == "auto")
+            return detect_fn();
+        if (s == "kitty")
+            return protocol_t::kitty;
+        if (s == "sixel")
+            return protocol_t::sixel;
+        return protocol_t::none;
+    }
+
+    struct logo_t
+    {
+            std::string payload; // escape sequence that draws the image at the cursor
+            size_t cols = 0;
+            size_t rows = 0;
+    };
+
+    struct rgb_t
+    {
+            size_t w = 0;
+            size_t h = 0;
+            std::vector<uint8_t> px; // w * h * 3
+    };
+
+    namespace detail
+    {
+        inline bool read_file_fn(const std::string &path, std::string &out)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+            out.clear();
+            char buf[65536];
+            for (;;)
+            {
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n > 0)
+                    out.append(buf, (size_t)n);
+                else if (n == 0 || errno != EINTR)
+                    break;
+            }
+            ::close(fd);
+            return true;
+        }
+
+        inline uint64_t fnv1a_fn(std::string_view s)
+        {
+            uint64_t h = 1469598103934665603ull;
+            for (unsigned char c : s)
+            {
+                h ^= c;
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
+        inline void base64_fn(std::string_view in, std::string &out)
+        {
+            static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            size_t i = 0;
+            out.reserve(out.size() + (in.size() + 2) / 3 * 4);
+            for (; i + 2 < in.size(); i += 3)
+            {
+                uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8) | (uint8_t)in[i + 2];
+                out += tbl[v >> 18];
+                out += tbl[(v >> 12) & 63];
+                out += tbl[(v >> 6) & 63];
+                out += tbl[v & 63];
+            }
+            if (i < in.size())
+            {
+                uint32_t v = (uint8_t)in[i] << 16;
+                if (i + 1 < in.size())
+                    v |= (uint8_t)in[i + 1] << 8;
+                out += tbl[v >> 18];
+                out += tbl[(v >> 12) & 63];
+                out += i + 1 < in.size() ? tbl[(v >> 6) & 63] : '=';
+                out += '=';
+            }
+        }
+
+        // Width and height from the IHDR chunk
+        // Larger images are refused rather than sized: a logo is a few hundred pixels
+        constexpr size_t max_dim = 16384;
+
+        inline bool png_size_fn(std::string_view d, size_t &w, size_t &h)
+        {
+            if (d.size() < 24 || d.substr(0, 8) != std::string_view("\x89PNG\r\n\x1a\n", 8) || d.substr(12, 4) != "IHDR")
+                return false;
+            auto be32 = [&](size_t o)
+            { return ((size_t)(uint8_t)d[o] << 24) | ((size_t)(uint8_t)d[o + 1] << 16) | ((size_t)(uint8_t)d[o + 2] << 8) | (uint8_t)d[o + 3]; };
+            w = be32(16);
+            h = be32(20);
+            return w && h && w <= max_dim && h <= max_dim;
+        }
+
+        // Binary PPM (P6), maxval up to 255
+        inline bool parse_ppm_fn(std::string_view d, rgb_t &img)
+        {
+            if (d.size() < 2 || d[0] != 'P' || d[1] != '6')
+                return false;
+            size_t pos = 2;
+            // width, height, maxval
+            static constexpr size_t limit[3] = {max_dim, max_dim, 255};
+            size_t hdr[3];
+            for (size_t f = 0; f < 3; ++f)
+            {
+                size_t &v = hdr[f];
+                // whitespace and # comments between fields
+                while (pos < d.size() && (std::isspace((unsigned char)d[pos]) || d[pos] == '#'))
+                {
+                    if (d[pos] == '#')
+                        while (pos < d.size() && d[pos] != '\n')
+                            ++pos;
+                    else
+                        ++pos;
+                }
+                v = 0;
+                size_t start = pos;
+                while (pos < d.size() && std::isdigit((unsigned char)d[pos]))
+                {
+                    v = v * 10 + (size_t)(d[pos++] - '0');
+                    if (v > limit[f])
+                        return false;
+                }
+                if (pos == start || v == 0)
+                    return false;
+            }
+            ++pos; // single whitespace before the raster
+
+            // both sides are capped, so this cannot wrap; checked anyway for whoever raises max_dim
+            size_t n = hdr[0] * hdr[1];
+            if (n / hdr[0] != hdr[1] || n > SIZE_MAX / 3)
+                return false;
+            n *= 3;
+            if (pos > d.size() || n > d.size() - pos)
+                return false;
+            img.w = hdr[0];
+            img.h = hdr[1];
+            img.px.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                img.px[i] = (uint8_t)std::min<size_t>(255, (uint8_t)d[pos + i] * 255 / hdr[2]);
+            return true;
+        }
+
+        // Nearest neighbour
+        inline rgb_t scale_fn(const rgb_t &src, size_t w, size_t h)
+        {
+            rgb_t out;
+            out.w = w;
+            out.h = h;
+            out.px.resize(w * h * 3);
+            for (size_t y = 0; y < h; ++y)
+            {
+                size_t sy = y * src.h / h;
+                for (size_t x = 0; x < w; ++x)
+                {
+                    size_t sx = x * src.w / w;
+                    std::memcpy(&out.px[(y * w + x) * 3], &src.px[(sy * src.w + sx) * 3], 3);
+                }
+            }
+            return out;
+        }
+
+        // APC chunks of at most 4096 base64 bytes; the first carries the keys
+        inline std::string kitty_fn(std::string_view data, const std::string &keys)
+        {
+            std::string b64;
+            base64_fn(data, b64);
+            std::string out;
+            out.reserve(b64.size() + b64.size() / 4096 * 16 + keys.size() + 32);
+            for (size_t off = 0; off < b64.size() || off == 0; off += 4096)
+            {
+                bool last = off + 4096 >= b64.size();
+                out += "\033_G";
+                if (off == 0)
+                    out += keys + ",";
+                out += last ? "m=0;" : "m=1;";
+                out.append(b64, off, 4096);
+                out += "\033\\";
+                if (last)
+                    break;
+            }
+            return out;
+        }
+
+        inline std::string sixel_fn(const rgb_t &img)
+        {
+            auto idx = [&](size_t x, size_t y)
+            {
+                const uint8_t *p = &img.px[(y * img.w + x) * 3];
+                return (p[0] * 6 / 256) * 36 + (p[1] * 6 / 256) * 6 + (p[2] * 6 / 256);
+            };
+
+            std::string out = "\033Pq\"1;1;" + std::to_string(img.w) + ";" + std::to_string(img.h);
+            bool used[216] = {};
+            for (size_t y = 0; y < img.h; ++y)
+                for (size_t x = 0; x < img.w; ++x)
+                    used[idx(x, y)] = true;
+            char def[48];
+            for (int c = 0; c < 216; ++c)
+            {
+                if (!used[c])
+                    continue;
+                std::snprintf(def, sizeof(def), "#%d;2;%d;%d;%d", c, c / 36 * 20, c / 6 % 6 * 20, c % 6 * 20);
+                out += def;
+            }
+
+            std::vector<uint8_t> bits(img.w);
+            for (size_t y0 = 0; y0 < img.h; y0 += 6)
+            {
+                bool band_used[216] = {};
+                for (size_t y = y0; y < std::min(y0 + 6, img.h); ++y)
+                    for (size_t x = 0; x < img.w; ++x)
+                        band_used[idx(x, y)] = true;
+
+                bool first = true;
+                for (int c = 0; c < 216; ++c)
+                {
+                    if (!band_used[c])
+                        continue;
+                    std::fill(bits.begin(), bits.end(), 0);
+                    for (size_t y = y0; y < std::min(y0 + 6, img.h); ++y)
+                        for (size_t x = 0; x < img.w; ++x)
+                            if (idx(x, y) == c)
+                                bits[x] |= (uint8_t)(1 << (y - y0));
+
+                    if (!first)
+                        out += '$'; // back to the band start, next colour
+                    first = false;
+                    out += '#' + std::to_string(c);
+
+                    // run-length: !<n><char>
+                    for (size_t x = 0; x < img.w;)
+                    {
+                        size_t run = 1;
+                        while (x + run < img.w && bits[x + run] == bits[x])
+                            ++run;
+                        char ch = (char)(63 + bits[x]);
+                        if (run > 3)
+                            out += '!' + std::to_string(run) + ch;
+                        else
+                            out.append(run, ch);
+                        x += run;
+                    }
+                }
+                out += '-';
+            }
+            out += "\033\\";
+            return out;
+        }
+
+    } // namespace detail
+
+    // Loads path as a logo of cols x rows cells (rows = 0: keep the aspect ratio).
+    // Returns false, with a reason in err, if the file or format does not fit the protocol.
+    inline bool load_fn(const std::string &path, size_t cols, size_t rows, protocol_t proto, const layout_ns::term_size_t &term, logo_t &logo, std::string &err)
+    {
+        MFETCH_SCOPE_D("image", path.c_str());
+        std::string data;
+        if (!detail::read_file_fn(path, data))
+        {
+            err = "cannot read '" + path + "'";
+            return false;
+        }
+
+        size_t cw = term.xpixel && term.cols ? term.xpixel / term.cols : 10;
+        size_t ch = term.ypixel && term.rows ? term.ypixel / term.rows : 20;
+        cols = cols ? cols : 24;
+
+        size_t w = 0, h = 0;
+        rgb_t img;
+        bool png = detail::png_size_fn(data, w, h);
+        bool ppm = !png && detail::parse_ppm_fn(data, img);
+        if (ppm)
+        {
+            w = img.w;
+            h = img.h;
+        }
+        if (!png && !ppm)
+        {
+            err = "'" + path + "' is not a PNG or binary PPM";
+            return false;
+        }
+        if (png && proto == protocol_t::sixel)
+        {
+            err = "sixel needs a PPM image, '" + path + "' is a PNG";
+            return false;
+        }
+        if (!rows)
+            rows = std::max<size_t>(1, (cols * cw * h + w * ch / 2) / (w * ch));
+        logo.cols = cols;
+        logo.rows = rows;
+
+        char key[128];
+        std::snprintf(key, sizeof(key), "%016llx-%zux%zu-%zux%zu-%s.bin", (unsigned long long)detail::fnv1a_fn(data), cols, rows, cw, ch, protocol_name_fn(proto));
+        std::string cache_path = util_ns::cache_dir_fn() + "/" + key;
+        if (detail::read_file_fn(cache_path, logo.payload) && !logo.payload.empty())
+            return true;
+
+        {
+            MFETCH_SCOPE_D("image:encode", protocol_name_fn(proto));
+            if (proto == protocol_t::kitty)
+            {
+                // C=1: leave the cursor where it was; q=2: no replies on stdin
+                std::string keys = "a=T,q=2,C=1,c=" + std::to_string(cols) + ",r=" + std::to_string(rows);
+                if (png)
+                    logo.payload = detail::kitty_fn(data, "f=100," + keys);
+                else
+                    logo.payload = detail::kitty_fn(std::string_view((const char *)img.px.data(), img.px.size()),
+                                                    "f=24,s=" + std::to_string(w) + ",v=" + std::to_string(h) + "," + keys);
+            }
+            else
+            {
+                // whole sixel bands only, so nothing spills into the row below the box
+                size_t ph = rows * ch / 6 * 6;
+                logo.payload = detail::sixel_fn(detail::scale_fn(img, cols * cw, std::max<size_t>(ph, 6)));
+            }
+        }
+
+        // a cache we cannot write only costs the next run an encode
+        std::error_code ec;
+        std::filesystem::create_directories(util_ns::cache_dir_fn(), ec);
+        try
+        {
+            util_ns::write_file_atomic_fn(cache_path, logo.payload);
+        }
+        catch (const std::exception &)
+        {
+        }
+        return true;
+    }
+} // namespace image_ns
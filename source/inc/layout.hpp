@@ -0,0 +1,335 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace layout_ns
+{
+    enum class position_t
+    {
+        left,
+        right,
+        top,
+        none
+    };
+
+    inline position_t parse_position_fn(const std::string &s)
+    {
+        if (s == "right")
+            return position_t::right;
+        if (s == "top")
+            return position_t::top;
+        if (s == "none" || s == "off")
+            return position_t::none;
+        return position_t::left;
+    }
+
+    struct term_size_t
+    {
+            size_t cols = 0; // 0 = unbounded (not a tty, no $COLUMNS)
+            size_t rows = 0;
+            size_t xpixel = 0;
+            size_t ypixel = 0;
+    };
+
+    // One TIOCGWINSZ per run - stdout first, then stderr (stdout may be piped into less -R)
+    inline term_size_t query_term_fn()
+    {
+        term_size_t ts;
+        struct winsize ws = {};
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 || ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == 0)
+        {
+            ts.cols = ws.ws_col;
+            ts.rows = ws.ws_row;
+            ts.xpixel = ws.ws_xpixel;
+            ts.ypixel = ws.ws_ypixel;
+            return ts;
+        }
+
+        const char *c = std::getenv("COLUMNS");
+        if (c)
+            ts.cols = std::strtoul(c, nullptr, 10);
+        return ts;
+    }
+
+    // Visible width for UTF-8 and ANSI
+    inline size_t visible_len_fn(const std::string &s)
+    {
+        size_t len = 0;
+        bool in_esc = false;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            unsigned char c = s[i];
+            if (c == '\033')
+                in_esc = true;
+            else if (in_esc)
+            {
+                if (c == 'm')
+                    in_esc = false;
+            }
+            else
+            {
+                if ((c & 0xc0) != 0x80)
+                {
+                    len++;
+                }
+            }
+        }
+        return len;
+    }
+
+    // Cuts s after max_w visible cells, keeping escapes intact.
+    // Appends a reset if anything styled got cut off.
+    inline void truncate_visible_fn(std::string &s, size_t max_w)
+    {
+        size_t len = 0;
+        bool in_esc = false;
+        bool styled = false;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            unsigned char c = s[i];
+            if (c == '\033')
+            {
+                in_esc = true;
+                styled = true;
+            }
+            else if (in_esc)
+            {
+                if (c == 'm')
+                    in_esc = false;
+            }
+            else if ((c & 0xc0) != 0x80)
+            {
+                if (len == max_w)
+                {
+                    s.resize(i);
+                    if (styled)
+                        s += "\033[0m";
+                    return;
+                }
+                len++;
+            }
+        }
+    }
+
+    // A block of pre-rendered lines with their visible widths
+    struct block_t
+    {
+            struct line_t
+            {
+                    std::string text;
+                    size_t width = 0;
+                    int indent = 0;
+            };
+
+            std::vector<line_t> lines;
+            size_t width = 0;
+
+            void push_fn(std::string text, int indent = 0)
+            {
+                size_t w = visible_len_fn(text);
+                size_t extent = w + (size_t)std::max(indent, 0);
+                if (extent > width)
+                    width = extent;
+                lines.push_back({std::move(text), w, indent});
+            }
+
+            // Width known up front (embedded configs measure their art at build time)
+            void push_measured_fn(std::string text, size_t w)
+            {
+                if (w > width)
+                    width = w;
+                lines.push_back({std::move(text), w, 0});
+            }
+    };
+
+    // Row-major cell grid. Every row is filled strictly left to right,
+    // so placing a block is a single append per row.
+    class grid_t
+    {
+            struct row_t
+            {
+                    std::string text;
+                    size_t width = 0;
+            };
+
+            std::vector<row_t> rows;
+
+        public:
+            explicit grid_t(size_t height) : rows(height)
+            {
+            }
+
+            size_t height_fn() const
+            {
+                return rows.size();
+            }
+
+            size_t row_width_fn(size_t r) const
+            {
+                return rows[r].width;
+            }
+
+            void put_fn(size_t r, size_t col, const std::string &text, size_t w)
+            {
+                auto &row = rows[r];
+                if (col > row.width)
+                {
+                    row.text.append(col - row.width, ' ');
+                    row.width = col;
+                }
+                row.text += text;
+                row.width += w;
+            }
+
+            // Writes the whole grid into out, cutting rows at max_w (0 = no limit)
+            void serialize_fn(std::string &out, size_t max_w) const
+            {
+                size_t total = 0;
+                for (const auto &row : rows)
+                    total += row.text.size() + 1;
+                out.reserve(out.size() + total);
+
+                for (const auto &row : rows)
+                {
+                    size_t start = out.size();
+                    out += row.text;
+                    if (max_w && row.width > max_w)
+                    {
+                        std::string tail = out.substr(start);
+                        truncate_visible_fn(tail, max_w);
+                        out.resize(start);
+                        out += tail;
+                    }
+                    // trailing padding is noise in narrow panes
+                    while (out.size() > start && out.back() == ' ')
+                        out.pop_back();
+                    out += '\n';
+                }
+            }
+    };
+
+    struct layout_opts_t
+    {
+            position_t position = position_t::left;
+            size_t margin = 1;
+            size_t gap = 2;
+            size_t art_min_w = 0;
+            size_t top_padding = 0;
+            size_t bottom_padding = 0;
+            size_t term_cols = 0;
+    };
+
+    // Where the art ended up, for drawing over its cells afterwards
+    struct placed_t
+    {
+            position_t position = position_t::none;
+            size_t row = 0;  // first art row
+            size_t col = 0;  // first art column
+            size_t rows = 0; // rows written in total
+    };
+
+    // Places art and info into a grid and serialises it into out in one go.
+    // When the terminal is too narrow the art goes first: side art is dropped,
+    // top art is cut; info lines are only ever truncated.
+    inline placed_t compose_fn(const block_t &art, const block_t &info, const layout_opts_t &o, std::string &out)
+    {
+        position_t pos = art.lines.empty() ? position_t::none : o.position;
+        size_t art_w = std::max(art.width, o.art_min_w);
+
+        if (o.term_cols && (pos == position_t::left || pos == position_t::right))
+        {
+            if (o.margin + art_w + o.gap + info.width > o.term_cols)
+                pos = position_t::top;
+        }
+        if (o.term_cols && pos == position_t::top && o.margin >= o.term_cols)
+            pos = position_t::none;
+
+        size_t art_rows = (pos == position_t::none) ? 0 : art.lines.size();
+        size_t body_rows = 0;
+        size_t info_row0 = 0;
+        if (pos == position_t::top)
+        {
+            // drop the art rather than show a sliver of it
+            if (o.term_cols && o.term_cols < o.margin + art.width / 2)
+            {
+                pos = position_t::none;
+                art_rows = 0;
+            }
+            else
+            {
+                info_row0 = art_rows + (art_rows ? 1 : 0);
+            }
+        }
+        body_rows = std::max(art_rows, info_row0 + info.lines.size());
+
+        grid_t grid(o.top_padding + body_rows + o.bottom_padding);
+        size_t r0 = o.top_padding;
+        placed_t placed{pos, r0, o.margin, grid.height_fn()};
+
+        // info column for left/top/none follows the legacy spacing rules:
+        // at least one space after the art, negative indents pull into the gap
+        auto info_col_fn = [&](const block_t::line_t &l, size_t row_w, size_t base)
+        {
+            long want = (long)base + l.indent;
+            long min_col = (long)row_w + 1;
+            return (size_t)std::max(want, min_col);
+        };
+
+        switch (pos)
+        {
+            case position_t::left:
+                for (size_t i = 0; i < body_rows; ++i)
+                {
+                    if (i < art.lines.size())
+                        grid.put_fn(r0 + i, o.margin, art.lines[i].text, art.lines[i].width);
+                    else
+                        grid.put_fn(r0 + i, o.margin, "", 0);
+
+                    if (i < info.lines.size())
+                    {
+                        const auto &l = info.lines[i];
+                        grid.put_fn(r0 + i, info_col_fn(l, grid.row_width_fn(r0 + i), o.margin + art_w + o.gap), l.text, l.width);
+                    }
+                }
+                break;
+
+            case position_t::right:
+            {
+                size_t art_col = o.margin + info.width + o.gap;
+                placed.col = art_col;
+                for (size_t i = 0; i < body_rows; ++i)
+                {
+                    if (i < info.lines.size())
+                    {
+                        const auto &l = info.lines[i];
+                        grid.put_fn(r0 + i, o.margin + (size_t)std::max(l.indent, 0), l.text, l.width);
+                    }
+                    if (i < art.lines.size())
+                        grid.put_fn(r0 + i, art_col, art.lines[i].text, art.lines[i].width);
+                }
+                break;
+            }
+
+            case position_t::top:
+            case position_t::none:
+                for (size_t i = 0; i < art_rows; ++i)
+                    grid.put_fn(r0 + i, o.margin, art.lines[i].text, art.lines[i].width);
+                for (size_t i = 0; i < info.lines.size(); ++i)
+                {
+                    const auto &l = info.lines[i];
+                    size_t r = r0 + info_row0 + i;
+                    grid.put_fn(r, o.margin, "", 0);
+                    grid.put_fn(r, info_col_fn(l, grid.row_width_fn(r), o.margin + o.gap), l.text, l.width);
+                }
+                break;
+        }
+
+        grid.serialize_fn(out, o.term_cols);
+        return placed;
+    }
+} // namespace layout_ns
@@ -0,0 +1,85 @@
+/* mfetch probe plugin ABI.
+ *
+ * A plugin is a shared object in ~/.config/mfetch/plugins/<name>.so that exports
+ *
+ *     const struct mfetch_plugin *mfetch_plugin_v1(void);
+ *
+ * Its keys are addressed as <name>.<key> in formats ("{inventory.rack}",
+ * "[inventory.rack -upper]"). mfetch only loads a plugin when a config uses one
+ * of its keys, and calls probe() at most once per run (again per refresh for
+ * live / slow plugins in long-running modes).
+ *
+ * Plain C, no allocations cross the boundary: mfetch owns every buffer.
+ */
+#ifndef MFETCH_PLUGIN_H
+#define MFETCH_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MFETCH_PLUGIN_ABI 1
+#define MFETCH_PLUGIN_ENTRY "mfetch_plugin_v1"
+
+/* How expensive probe() is; shown in --timings */
+enum mfetch_cost
+{
+    MFETCH_COST_CHEAP = 0, /* memory or a syscall */
+    MFETCH_COST_IO = 1,    /* file or socket reads */
+    MFETCH_COST_SPAWN = 2, /* runs other programs */
+};
+
+/* How long values stay true, same meaning as the built-in probes */
+enum mfetch_volatility
+{
+    MFETCH_FIXED = 0, /* until reboot */
+    MFETCH_SLOW = 1,  /* minutes */
+    MFETCH_LIVE = 2,  /* every refresh */
+};
+
+enum mfetch_kind
+{
+    MFETCH_TEXT = 0,
+    MFETCH_COUNT = 1, /* decimal integer text: a number in --output json / ndjson and a
+                         mfetch_plugin_value sample in --prometheus; other text stays text */
+};
+
+struct mfetch_key
+{
+    const char *name; /* [a-z0-9_-]+ */
+    uint8_t kind;     /* enum mfetch_kind */
+};
+
+/* One per key, in the order of mfetch_plugin.keys */
+struct mfetch_value
+{
+    char *buf;  /* owned by mfetch, cap bytes, not NUL terminated */
+    size_t cap;
+    size_t len; /* set by the plugin, 0 = no value; clamped to cap */
+};
+
+struct mfetch_plugin
+{
+    uint32_t abi;  /* MFETCH_PLUGIN_ABI */
+    uint32_t size; /* sizeof(struct mfetch_plugin), for later additions */
+    const char *name;
+    const struct mfetch_key *keys;
+    uint32_t key_count;
+    uint8_t cost;       /* enum mfetch_cost */
+    uint8_t volatility; /* enum mfetch_volatility */
+
+    /* Fills values[0 .. key_count). Returns 0 on success. */
+    int (*probe)(struct mfetch_value *values, void *user);
+    void *user;
+};
+
+typedef const struct mfetch_plugin *(*mfetch_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MFETCH_PLUGIN_H */
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <cctype>
+
+// Numbers into text, appended straight to the output buffer through
+// std::to_chars: no streams, no locale, no temporaries.
+//
+// Byte values arrive in kB (what /proc and statvfs give us) and are shown in
+//   B, KiB, MiB, GiB, TiB     binary (1024)
+//   B, kB, MB, GB, TB         decimal (1000)
+// or "auto", which picks the largest unit the value reaches.
+namespace numfmt_ns
+{
+    enum class scale_t : uint8_t
+    {
+        b,
+        k,
+        m,
+        g,
+        t,
+        auto_,
+    };
+
+    struct unit_t
+    {
+            scale_t scale = scale_t::g;
+            bool decimal = false;
+            bool terse = false;    // "5.9g": one-letter suffix glued to the number (the {key} style)
+            bool explicit_ = false; // set by the config, not defaulted
+    };
+
+    // What {ram_used} always printed: GiB, one decimal, "g"
+    inline constexpr unit_t legacy_unit{scale_t::g, false, true, false};
+
+    // b kib mib gib tib | kb mb gb tb | auto auto-si ("" = GiB). false if s is none of these.
+    inline bool parse_unit_fn(std::string_view s, unit_t &u)
+    {
+        std::string l;
+        for (char c : s)
+            l += (char)std::tolower((unsigned char)c);
+
+        u = unit_t{};
+        if (l.empty())
+            return true;
+        u.explicit_ = true;
+        if (l == "auto" || l == "auto-si")
+        {
+            u.scale = scale_t::auto_;
+            u.decimal = l == "auto-si";
+            return true;
+        }
+        if (l == "b")
+        {
+            u.scale = scale_t::b;
+            return true;
+        }
+
+        static constexpr std::string_view letters = "kmgt";
+        auto at = letters.find(l[0]);
+        if (at == std::string_view::npos || (l.size() != 2 && l.size() != 3) || l.back() != 'b' || (l.size() == 3 && l[1] != 'i'))
+            return false;
+        u.scale = (scale_t)(at + 1);
+        u.decimal = l.size() == 2;
+        return true;
+    }
+
+    inline unit_t parse_unit_fn(std::string_view s)
+    {
+        unit_t u;
+        if (!parse_unit_fn(s, u))
+            u = unit_t{};
+        return u;
+    }
+
+    inline std::string_view suffix_fn(const unit_t &u, scale_t s)
+    {
+        static constexpr std::string_view binary[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        static constexpr std::string_view decimal[] = {"B", "kB", "MB", "GB", "TB"};
+        static constexpr std::string_view terse[] = {"b", "k", "m", "g", "t"};
+        size_t i = s == scale_t::auto_ ? (size_t)scale_t::g : (size_t)s;
+        return u.terse ? terse[i] : u.decimal ? decimal[i] : binary[i];
+    }
+
+    inline void append_int_fn(std::string &out, long long v)
+    {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        out.append(buf, (size_t)(r.ptr - buf));
+    }
+
+    inline void append_fixed_fn(std::string &out, double v, int prec)
+    {
+        char buf[64];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, prec);
+        if (r.ec == std::errc())
+            out.append(buf, (size_t)(r.ptr - buf));
+    }
+
+    // fixed point x1000: 1234 -> "1.234", 1500 -> "1.5", 2000 -> "2"
+    inline void append_milli_fn(std::string &out, long long n)
+    {
+        unsigned long long a = n < 0 ? 0ull - (unsigned long long)n : (unsigned long long)n;
+        if (n < 0)
+            out += '-';
+        append_int_fn(out, (long long)(a / 1000));
+        unsigned frac = (unsigned)(a % 1000);
+        if (!frac)
+            return;
+        char f[4] = {'.', (char)('0' + frac / 100), (char)('0' + frac / 10 % 10), (char)('0' + frac % 10)};
+        size_t len = 4;
+        while (f[len - 1] == '0')
+            --len;
+        out.append(f, len);
+    }
+
+    // kb in unit u, prec decimals (-1: 1, none for plain bytes). Returns the scale used, for [unit].
+    inline scale_t append_bytes_fn(std::string &out, long long kb, const unit_t &u, int prec = -1)
+    {
+        double base = u.decimal ? 1000.0 : 1024.0;
+        double v = (double)kb * 1024.0;
+        scale_t s = u.scale;
+        if (s == scale_t::auto_)
+        {
+            s = scale_t::b;
+            double a = v < 0 ? -v : v;
+            while (s < scale_t::t && a >= base)
+            {
+                a /= base;
+                s = (scale_t)((int)s + 1);
+            }
+        }
+        for (int i = 0; i < (int)s; ++i)
+            v /= base;
+
+        if (prec < 0)
+            prec = s == scale_t::b ? 0 : 1;
+        append_fixed_fn(out, v, prec);
+        return s;
+    }
+
+    // part / whole as "12.5%"; "?" when whole is zero
+    inline void append_percent_fn(std::string &out, long long part, long long whole, int prec = -1)
+    {
+        if (whole == 0)
+        {
+            out += '?';
+            return;
+        }
+        append_fixed_fn(out, (double)part * 100.0 / (double)whole, prec < 0 ? 1 : prec);
+        out += '%';
+    }
+
+    // Bytes with their suffix, for places without a [unit] of their own: "5.9g", "5.9 GiB"
+    inline std::string bytes_fn(long long kb, const unit_t &u = legacy_unit)
+    {
+        std::string out;
+        scale_t s = append_bytes_fn(out, kb, u);
+        if (!u.terse)
+            out += ' ';
+        out += suffix_fn(u, s);
+        return out;
+    }
+} // namespace numfmt_ns
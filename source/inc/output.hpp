@@ -0,0 +1,327 @@
+#pragma once
+
+#include "facts.hpp"
+#include "timing.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <bitset>
+#include <iostream>
+#include <charconv>
+
+// Machine-readable output: no art, no layout, typed values.
+// Byte values are raw kB, counts are plain integers, load and degrees are decimals.
+// Plugin keys follow the built-in ones as "plugin.key"; MFETCH_COUNT values are numbers.
+namespace output_ns
+{
+    enum class mode_t
+    {
+        none,
+        json,   // one pretty object
+        ndjson, // one compact object per line
+        kv,     // key=value lines, indexed keys as key.N
+    };
+
+    inline bool parse_mode_fn(const std::string &s, mode_t &m)
+    {
+        if (s == "json")
+            m = mode_t::json;
+        else if (s == "ndjson")
+            m = mode_t::ndjson;
+        else if (s == "kv")
+            m = mode_t::kv;
+        else
+            return false;
+        return true;
+    }
+
+    // Buffered writer, flushes in large chunks
+    class sink_t
+    {
+            std::ostream &os;
+            std::string buf;
+
+        public:
+            explicit sink_t(std::ostream &o) : os(o)
+            {
+                buf.reserve(16 * 1024);
+            }
+
+            ~sink_t()
+            {
+                flush_fn();
+            }
+
+            void write_fn(std::string_view s)
+            {
+                buf.append(s);
+                if (buf.size() >= 16 * 1024)
+                    flush_fn();
+            }
+
+            void put_fn(char c)
+            {
+                buf += c;
+            }
+
+            void flush_fn()
+            {
+                if (buf.empty())
+                    return;
+                os.write(buf.data(), (std::streamsize)buf.size());
+                os.flush();
+                buf.clear();
+            }
+    };
+
+    // Streaming JSON, no DOM. Tracks only whether a comma is due at each depth.
+    class json_writer_t
+    {
+            sink_t &sink;
+            bool pretty;
+            std::vector<bool> first;
+            bool after_key = false;
+
+            void indent_fn()
+            {
+                sink.put_fn('\n');
+                for (size_t i = 0; i < first.size(); ++i)
+                    sink.write_fn("  ");
+            }
+
+            void pre_value_fn()
+            {
+                if (after_key)
+                {
+                    after_key = false;
+                    return;
+                }
+                if (first.empty())
+                    return;
+                if (!first.back())
+                    sink.put_fn(',');
+                first.back() = false;
+            }
+
+            void escaped_fn(std::string_view s)
+            {
+                sink.put_fn('"');
+                for (unsigned char c : s)
+                {
+                    switch (c)
+                    {
+                        case '"':
+                            sink.write_fn("\\\"");
+                            break;
+                        case '\\':
+                            sink.write_fn("\\\\");
+                            break;
+                        case '\n':
+                            sink.write_fn("\\n");
+                            break;
+                        case '\t':
+                            sink.write_fn("\\t");
+                            break;
+                        case '\r':
+                            sink.write_fn("\\r");
+                            break;
+                        default:
+                            if (c < 0x20)
+                            {
+                                static const char hex[] = "0123456789abcdef";
+                                char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                                sink.write_fn(std::string_view(u, 6));
+                            }
+                            else
+                                sink.put_fn((char)c);
+                    }
+                }
+                sink.put_fn('"');
+            }
+
+        public:
+            json_writer_t(sink_t &s, bool p) : sink(s), pretty(p)
+            {
+            }
+
+            void begin_object_fn()
+            {
+                pre_value_fn();
+                sink.put_fn('{');
+                first.push_back(true);
+            }
+
+            void end_object_fn()
+            {
+                bool empty = first.back();
+                first.pop_back();
+                if (pretty && !empty)
+                    indent_fn();
+                sink.put_fn('}');
+            }
+
+            void begin_array_fn()
+            {
+                pre_value_fn();
+                sink.put_fn('[');
+                first.push_back(true);
+            }
+
+            void end_array_fn()
+            {
+                first.pop_back();
+                sink.put_fn(']');
+            }
+
+            void key_fn(std::string_view k)
+            {
+                if (!first.back())
+                    sink.put_fn(',');
+                first.back() = false;
+                if (pretty)
+                    indent_fn();
+                escaped_fn(k);
+                sink.write_fn(pretty ? ": " : ":");
+                after_key = true;
+            }
+
+            void string_fn(std::string_view v)
+            {
+                pre_value_fn();
+                escaped_fn(v);
+            }
+
+            void number_fn(long long v)
+            {
+                pre_value_fn();
+                char buf[24];
+                auto r = std::to_chars(buf, buf + sizeof(buf), v);
+                sink.write_fn(std::string_view(buf, (size_t)(r.ptr - buf)));
+            }
+
+            // pre-formatted JSON number
+            void raw_number_fn(std::string_view v)
+            {
+                pre_value_fn();
+                sink.write_fn(v);
+            }
+
+            void newline_fn()
+            {
+                sink.put_fn('\n');
+            }
+    };
+
+    inline void value_fn(json_writer_t &w, const facts_ns::value_t &v)
+    {
+        if (v.kind == facts_ns::kind_t::text)
+            w.string_fn(v.text);
+        else if (v.kind == facts_ns::kind_t::milli)
+            w.raw_number_fn(v.text);
+        else
+            w.number_fn(v.num);
+    }
+
+    // Writes the selected facts, then the selected plugin keys (registry slots),
+    // as fields of the currently open object
+    inline void fields_fn(json_writer_t &w, facts_ns::store_t &facts, const std::bitset<facts_ns::key_count> &keys, const std::vector<size_t> &plugins = {})
+    {
+        for (size_t k = 0; k < facts_ns::key_count; ++k)
+        {
+            if (!keys[k])
+                continue;
+            auto key = (facts_ns::key_t)k;
+            const auto &info = facts_ns::info_fn(key);
+
+            if (info.indexed)
+            {
+                w.key_fn(info.name);
+                w.begin_array_fn();
+                size_t n = facts.count_fn(key);
+                for (size_t i = 0; i < n; ++i)
+                    value_fn(w, *facts.get_fn(key, i));
+                w.end_array_fn();
+            }
+            else if (const auto *v = facts.get_fn(key))
+            {
+                w.key_fn(info.name);
+                value_fn(w, *v);
+            }
+        }
+
+        auto &reg = plugin_ns::registry_t::instance_fn();
+        for (size_t slot : plugins)
+        {
+            const auto *v = facts.plugin_value_fn(slot);
+            if (!v)
+                continue;
+            w.key_fn(reg.slot_fn(slot).full);
+            if (v->count)
+                w.number_fn(v->num);
+            else
+                w.string_fn(v->text);
+        }
+    }
+
+    inline void kv_fn(sink_t &sink, facts_ns::store_t &facts, const std::bitset<facts_ns::key_count> &keys, const std::vector<size_t> &plugins = {})
+    {
+        auto line = [&](std::string_view name, const std::string *idx, const std::string &text)
+        {
+            sink.write_fn(name);
+            if (idx)
+            {
+                sink.put_fn('.');
+                sink.write_fn(*idx);
+            }
+            sink.put_fn('=');
+            // one value per line, no matter what the probe returned
+            for (char c : text)
+                sink.put_fn(c == '\n' ? ' ' : c);
+            sink.put_fn('\n');
+        };
+
+        for (size_t k = 0; k < facts_ns::key_count; ++k)
+        {
+            if (!keys[k])
+                continue;
+            auto key = (facts_ns::key_t)k;
+            const auto &info = facts_ns::info_fn(key);
+
+            if (info.indexed)
+            {
+                size_t n = facts.count_fn(key);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    std::string idx = std::to_string(i);
+                    line(info.name, &idx, facts.get_fn(key, i)->text);
+                }
+            }
+            else if (const auto *v = facts.get_fn(key))
+                line(info.name, nullptr, v->text);
+        }
+
+        auto &reg = plugin_ns::registry_t::instance_fn();
+        for (size_t slot : plugins)
+        {
+            if (const auto *v = facts.plugin_value_fn(slot))
+                line(reg.slot_fn(slot).full, nullptr, v->text);
+        }
+    }
+
+    inline void write_fn(mode_t mode, facts_ns::store_t &facts, const std::bitset<facts_ns::key_count> &keys, std::ostream &os, const std::vector<size_t> &plugins = {})
+    {
+        MFETCH_SCOPE("output");
+        sink_t sink(os);
+        if (mode == mode_t::kv)
+        {
+            kv_fn(sink, facts, keys, plugins);
+            return;
+        }
+
+        json_writer_t w(sink, mode == mode_t::json);
+        w.begin_object_fn();
+        fields_fn(w, facts, keys, plugins);
+        w.end_object_fn();
+        w.newline_fn();
+    }
+} // namespace output_ns
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "mfetch_plugin.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <dirent.h>
+#include <dlfcn.h>
+
+// Shared-object probes, see mfetch_plugin.h for the ABI.
+//
+// Format compilation only interns "<plugin>.<key>" names into slots; the .so
+// is dlopen'ed the first time a store asks for one of its values.
+namespace plugin_ns
+{
+    struct slot_t
+    {
+            std::string plugin;
+            std::string key;
+            std::string full; // plugin.key
+    };
+
+    struct lib_t
+    {
+            std::string name;
+            void *handle = nullptr;
+            const mfetch_plugin *api = nullptr;
+    };
+
+    // $MFETCH_PLUGIN_DIR, or ~/.config/mfetch/plugins
+    inline std::string dir_fn()
+    {
+        if (const char *d = std::getenv("MFETCH_PLUGIN_DIR"))
+            return d;
+        const char *home = std::getenv("HOME");
+        return std::string(home ? home : "") + "/.config/mfetch/plugins";
+    }
+
+    inline bool valid_name_fn(std::string_view s)
+    {
+        if (s.empty())
+            return false;
+        for (char c : s)
+            if (!(std::islower((unsigned char)c) || std::isdigit((unsigned char)c) || c == '_' || c == '-'))
+                return false;
+        return true;
+    }
+
+    inline const char *cost_name_fn(uint8_t cost)
+    {
+        switch (cost)
+        {
+            case MFETCH_COST_CHEAP:
+                return "cheap";
+            case MFETCH_COST_IO:
+                return "io";
+            default:
+                return "spawn";
+        }
+    }
+
+    // Process-wide: interned key names and loaded libraries. Libraries stay loaded until exit.
+    class registry_t
+    {
+            std::mutex mtx;
+            std::deque<slot_t> slots; // stable references
+            std::deque<lib_t> libs;   // one per name, including failed loads (api == nullptr)
+
+            registry_t() = default;
+
+        public:
+            static registry_t &instance_fn()
+            {
+                static registry_t instance;
+                return instance;
+            }
+
+            // "inventory.rack" -> slot id, -1 if the name is not plugin-shaped. Loads nothing.
+            int intern_fn(std::string_view full)
+            {
+                auto dot = full.find('.');
+                if (dot == std::string_view::npos || !valid_name_fn(full.substr(0, dot)) || !valid_name_fn(full.substr(dot + 1)))
+                    return -1;
+
+                std::lock_guard<std::mutex> lock(mtx);
+                for (size_t i = 0; i < slots.size(); ++i)
+                    if (slots[i].full == full)
+                        return (int)i;
+                slots.push_back({std::string(full.substr(0, dot)), std::string(full.substr(dot + 1)), std::string(full)});
+                return (int)slots.size() - 1;
+            }
+
+            size_t slot_count_fn()
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                return slots.size();
+            }
+
+            const slot_t &slot_fn(size_t id)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                return slots[id];
+            }
+
+            // Already loaded api, without trying to load it
+            const mfetch_plugin *find_fn(const std::string &name)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (const auto &l : libs)
+                    if (l.name == name)
+                        return l.api;
+                return nullptr;
+            }
+
+            // dlopen once per name; nullptr (and one warning) if it is missing or speaks another ABI
+            const mfetch_plugin *load_fn(const std::string &name)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (const auto &l : libs)
+                    if (l.name == name)
+                        return l.api;
+
+                lib_t lib;
+                lib.name = name;
+                std::string path = dir_fn() + "/" + name + ".so";
+                std::string err;
+                lib.handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+                if (!lib.handle)
+                    err = dlerror();
+                else if (auto entry = (mfetch_plugin_entry_fn)dlsym(lib.handle, MFETCH_PLUGIN_ENTRY))
+                {
+                    const mfetch_plugin *api = entry();
+                    if (!api || api->abi != MFETCH_PLUGIN_ABI || api->size < sizeof(mfetch_plugin) || !api->probe)
+                        err = "unsupported plugin ABI (expected " + std::to_string(MFETCH_PLUGIN_ABI) + ")";
+                    else
+                        lib.api = api;
+                }
+                else
+                    err = "missing " MFETCH_PLUGIN_ENTRY "()";
+
+                if (!err.empty())
+                    std::cerr << "mfetch: plugin '" << name << "': " << err << "\n";
+                libs.push_back(std::move(lib));
+                return libs.back().api;
+            }
+
+            // Names of every *.so in the plugin dir, for --record
+            std::vector<std::string> installed_fn() const
+            {
+                std::vector<std::string> names;
+                if (DIR *d = opendir(dir_fn().c_str()))
+                {
+                    while (dirent *e = readdir(d))
+                    {
+                        std::string_view n = e->d_name;
+                        if (n.size() > 3 && n.substr(n.size() - 3) == ".so" && valid_name_fn(n.substr(0, n.size() - 3)))
+                            names.emplace_back(n.substr(0, n.size() - 3));
+                    }
+                    closedir(d);
+                }
+                return names;
+            }
+    };
+} // namespace plugin_ns
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "facts.hpp"
+#include "numfmt.hpp"
+#include "util.hpp"
+#include "timing.hpp"
+#include <string>
+#include <string_view>
+#include <charconv>
+
+// node_exporter textfile-collector output (exposition format 0.0.4)
+namespace prometheus_ns
+{
+    using facts_ns::key_t;
+
+    inline void label_value_fn(std::string &out, std::string_view v)
+    {
+        for (char c : v)
+        {
+            if (c == '\\' || c == '"')
+                out += '\\';
+            if (c == '\n')
+            {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+    }
+
+    class writer_t
+    {
+            std::string &out;
+
+        public:
+            explicit writer_t(std::string &o) : out(o)
+            {
+            }
+
+            void family_fn(std::string_view name, std::string_view help)
+            {
+                out += "# HELP ";
+                out += name;
+                out += ' ';
+                out += help;
+                out += "\n# TYPE ";
+                out += name;
+                out += " gauge\n";
+            }
+
+            // labels: "k1", "v1", "k2", "v2", ...
+            void sample_fn(std::string_view name, std::initializer_list<std::string_view> labels, long long v, bool milli = false)
+            {
+                out += name;
+                if (labels.size())
+                {
+                    out += '{';
+                    bool key = true;
+                    bool first = true;
+                    for (auto l : labels)
+                    {
+                        if (key)
+                        {
+                            if (!first)
+                                out += ',';
+                            out += l;
+                            out += "=\"";
+                        }
+                        else
+                        {
+                            label_value_fn(out, l);
+                            out += '"';
+                        }
+                        key = !key;
+                        first = false;
+                    }
+                    out += '}';
+                }
+                out += ' ';
+
+                if (milli)
+                    numfmt_ns::append_milli_fn(out, v);
+                else
+                    numfmt_ns::append_int_fn(out, v);
+                out += '\n';
+            }
+    };
+
+    // Every numeric fact, as gauges. Only families with samples are written.
+    inline void write_fn(facts_ns::store_t &facts, std::string &out)
+    {
+        writer_t w(out);
+
+        if (auto *v = facts.get_fn(key_t::host))
+        {
+            const auto *kern = facts.get_fn(key_t::kernel);
+            const auto *os = facts.get_fn(key_t::os);
+            w.family_fn("mfetch_info", "Static host facts as labels.");
+            w.sample_fn("mfetch_info", {"host", v->text, "kernel", kern ? kern->text : "", "os", os ? os->text : ""}, 1);
+        }
+
+        const auto *ru = facts.get_fn(key_t::ram_used);
+        const auto *rt = facts.get_fn(key_t::ram_total);
+        if (ru && rt)
+        {
+            w.family_fn("mfetch_memory_bytes", "Physical memory in bytes.");
+            w.sample_fn("mfetch_memory_bytes", {"state", "used"}, ru->num * 1024);
+            w.sample_fn("mfetch_memory_bytes", {"state", "total"}, rt->num * 1024);
+        }
+        const auto *su = facts.get_fn(key_t::swap_used);
+        const auto *st = facts.get_fn(key_t::swap_total);
+        if (su && st)
+        {
+            w.family_fn("mfetch_swap_bytes", "Swap space in bytes.");
+            w.sample_fn("mfetch_swap_bytes", {"state", "used"}, su->num * 1024);
+            w.sample_fn("mfetch_swap_bytes", {"state", "total"}, st->num * 1024);
+        }
+
+        if (size_t n = facts.count_fn(key_t::numa_mem_total))
+        {
+            w.family_fn("mfetch_numa_memory_bytes", "Memory per NUMA node in bytes.");
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::string node = std::to_string(facts.get_fn(key_t::numa_node, i)->num);
+                w.sample_fn("mfetch_numa_memory_bytes", {"node", node, "state", "used"}, facts.get_fn(key_t::numa_mem_used, i)->num * 1024);
+                w.sample_fn("mfetch_numa_memory_bytes", {"node", node, "state", "total"}, facts.get_fn(key_t::numa_mem_total, i)->num * 1024);
+            }
+        }
+
+        if (size_t n = facts.count_fn(key_t::pkg_count))
+        {
+            w.family_fn("mfetch_packages", "Installed packages per package manager.");
+            for (size_t i = 0; i < n; ++i)
+                w.sample_fn("mfetch_packages", {"manager", facts.get_fn(key_t::pkg_manager, i)->text}, facts.get_fn(key_t::pkg_count, i)->num);
+        }
+
+        if (auto *v = facts.get_fn(key_t::proc))
+        {
+            w.family_fn("mfetch_processes", "Number of processes.");
+            w.sample_fn("mfetch_processes", {}, v->num);
+        }
+
+        const auto *l1 = facts.get_fn(key_t::load1);
+        const auto *l5 = facts.get_fn(key_t::load5);
+        const auto *l15 = facts.get_fn(key_t::load15);
+        if (l1 && l5 && l15)
+        {
+            w.family_fn("mfetch_load_average", "System load average.");
+            w.sample_fn("mfetch_load_average", {"period", "1m"}, l1->num, true);
+            w.sample_fn("mfetch_load_average", {"period", "5m"}, l5->num, true);
+            w.sample_fn("mfetch_load_average", {"period", "15m"}, l15->num, true);
+        }
+
+        if (auto *v = facts.get_fn(key_t::uptime))
+        {
+            w.family_fn("mfetch_uptime_seconds", "Seconds since boot.");
+            w.sample_fn("mfetch_uptime_seconds", {}, v->num);
+        }
+
+        if (size_t n = facts.count_fn(key_t::temp))
+        {
+            w.family_fn("mfetch_temperature_celsius", "Thermal zone temperature.");
+            for (size_t i = 0; i < n; ++i)
+                w.sample_fn("mfetch_temperature_celsius", {"zone", facts.get_fn(key_t::temp_zone, i)->text}, facts.get_fn(key_t::temp, i)->num, true);
+        }
+
+        if (size_t n = facts.count_fn(key_t::mnt_total))
+        {
+            w.family_fn("mfetch_filesystem_bytes", "Filesystem size and usage in bytes.");
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::string_view point = facts.get_fn(key_t::mnt_point, i)->text;
+                std::string_view dev = facts.get_fn(key_t::mnt_dev, i)->text;
+                w.sample_fn("mfetch_filesystem_bytes", {"mountpoint", point, "device", dev, "state", "used"}, facts.get_fn(key_t::mnt_used, i)->num * 1024);
+                w.sample_fn("mfetch_filesystem_bytes", {"mountpoint", point, "device", dev, "state", "total"}, facts.get_fn(key_t::mnt_total, i)->num * 1024);
+            }
+        }
+
+        // MFETCH_COUNT keys of the plugins interned so far
+        auto &reg = plugin_ns::registry_t::instance_fn();
+        bool family = false;
+        for (size_t s = 0; s < reg.slot_count_fn(); ++s)
+        {
+            const auto *v = facts.plugin_value_fn(s);
+            if (!v || !v->count)
+                continue;
+            if (!family)
+                w.family_fn("mfetch_plugin_value", "Numeric plugin values.");
+            family = true;
+            const auto &slot = reg.slot_fn(s);
+            w.sample_fn("mfetch_plugin_value", {"plugin", slot.plugin, "key", slot.key}, v->num);
+        }
+    }
+
+    inline void export_fn(facts_ns::store_t &facts, const std::string &path)
+    {
+        std::string out;
+        out.reserve(4096);
+        write_fn(facts, out);
+        MFETCH_SCOPE("output");
+        util_ns::write_file_atomic_fn(path, out);
+    }
+} // namespace prometheus_ns
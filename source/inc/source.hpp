@@ -0,0 +1,402 @@
+#pragma once
+
+#include "util.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/statvfs.h>
+
+// Everything a probe reads goes through a source_t: files, directory listings,
+// statvfs, env vars and commands. That gives one place to
+//   - prefix reads with a sysroot (--sysroot),
+//   - capture every input into a snapshot (--record),
+//   - serve them back without touching the system (--replay).
+//
+// Snapshot: a "mfetch-snapshot 1" line, then one record per input
+//
+//   <tag> <key length> <value length or -1 if absent>\n<key><value>
+//
+// tags: f file, d dir listing (names, '\n' separated), s statvfs ("total used" kB),
+//       e env var, x command output, p plugin value
+namespace source_ns
+{
+    enum class mode_t : uint8_t
+    {
+        live,
+        record,
+        replay,
+    };
+
+    class source_t
+    {
+            std::string root;
+            mode_t mode = mode_t::live;
+            std::unordered_map<std::string, std::optional<std::string>> snap;
+
+            static std::string snap_key_fn(char tag, std::string_view key)
+            {
+                std::string k(1, tag);
+                k += key;
+                return k;
+            }
+
+            // nullptr: never recorded
+            const std::optional<std::string> *lookup_fn(char tag, std::string_view key) const
+            {
+                auto it = snap.find(snap_key_fn(tag, key));
+                return it == snap.end() ? nullptr : &it->second;
+            }
+
+            void keep_fn(char tag, std::string_view key, std::optional<std::string> v)
+            {
+                if (mode == mode_t::record)
+                    snap[snap_key_fn(tag, key)] = std::move(v);
+            }
+
+            std::string path_fn(std::string_view p) const
+            {
+                return root.empty() ? std::string(p) : root + std::string(p);
+            }
+
+            static bool read_live_fn(const std::string &path, std::string &out, size_t max)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return false;
+                out.clear();
+                // procfs and sysfs report size 0, so read until EOF
+                char buf[4096];
+                while (out.size() < max)
+                {
+                    ssize_t n = ::read(fd, buf, std::min(sizeof(buf), max - out.size()));
+                    if (n > 0)
+                        out.append(buf, (size_t)n);
+                    else if (n == 0 || errno != EINTR)
+                        break;
+                }
+                ::close(fd);
+                return true;
+            }
+
+        public:
+            // root: prefix for every path ("" = the running system)
+            explicit source_t(std::string r = "") : root(std::move(r))
+            {
+                while (!root.empty() && root.back() == '/')
+                    root.pop_back();
+            }
+
+            source_t(const source_t &) = delete;
+            source_t &operator=(const source_t &) = delete;
+
+            // The running system, shared by everything that does not ask for another source
+            static source_t &live_fn()
+            {
+                static source_t instance;
+                return instance;
+            }
+
+            mode_t mode_fn() const
+            {
+                return mode;
+            }
+
+            const std::string &root_fn() const
+            {
+                return root;
+            }
+
+            // Whole file (up to max bytes). false if it cannot be opened.
+            bool read_fn(std::string_view path, std::string &out, size_t max = SIZE_MAX)
+            {
+                if (mode == mode_t::replay)
+                {
+                    auto *v = lookup_fn('f', path);
+                    if (!v || !*v)
+                        return false;
+                    out = **v;
+                    return true;
+                }
+                bool ok = read_live_fn(path_fn(path), out, max);
+                keep_fn('f', path, ok ? std::optional<std::string>(out) : std::nullopt);
+                return ok;
+            }
+
+            // First line of a file, without the newline
+            bool read_line_fn(std::string_view path, std::string &out)
+            {
+                if (!read_fn(path, out, 4096))
+                    return false;
+                auto nl = out.find('\n');
+                if (nl != std::string::npos)
+                    out.resize(nl);
+                return true;
+            }
+
+            // Several small files of one directory: the directory is resolved once and
+            // each name opened relative to it. Recorded and replayed as dir/name, like read_fn.
+            std::vector<std::optional<std::string>> read_batch_fn(std::string_view dir, std::initializer_list<std::string_view> names, size_t max = 4096)
+            {
+                std::vector<std::optional<std::string>> out;
+                out.reserve(names.size());
+                std::string full(dir);
+                full += '/';
+                size_t base = full.size();
+
+                if (mode == mode_t::replay)
+                {
+                    for (auto n : names)
+                    {
+                        full.resize(base);
+                        full += n;
+                        auto *v = lookup_fn('f', full);
+                        out.push_back(v ? *v : std::nullopt);
+                    }
+                    return out;
+                }
+
+                int dfd = ::open(path_fn(dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                char buf[4096];
+                for (auto n : names)
+                {
+                    std::optional<std::string> v;
+                    std::string name(n);
+                    int fd = dfd < 0 ? -1 : ::openat(dfd, name.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd >= 0)
+                    {
+                        v.emplace();
+                        while (v->size() < max)
+                        {
+                            ssize_t r = ::read(fd, buf, std::min(sizeof(buf), max - v->size()));
+                            if (r > 0)
+                                v->append(buf, (size_t)r);
+                            else if (r == 0 || errno != EINTR)
+                                break;
+                        }
+                        ::close(fd);
+                    }
+                    if (mode == mode_t::record)
+                    {
+                        full.resize(base);
+                        full += n;
+                        keep_fn('f', full, v);
+                    }
+                    out.push_back(std::move(v));
+                }
+                if (dfd >= 0)
+                    ::close(dfd);
+                return out;
+            }
+
+            // Entry names in dir, sorted, without "." and ".."
+            std::vector<std::string> list_fn(std::string_view dir)
+            {
+                std::vector<std::string> names;
+                if (mode == mode_t::replay)
+                {
+                    auto *v = lookup_fn('d', dir);
+                    if (v && *v && !(*v)->empty())
+                        names = util_ns::split_fn(**v, '\n');
+                    return names;
+                }
+
+                if (DIR *d = ::opendir(path_fn(dir).c_str()))
+                {
+                    while (dirent *e = ::readdir(d))
+                    {
+                        if (std::strcmp(e->d_name, ".") != 0 && std::strcmp(e->d_name, "..") != 0)
+                            names.emplace_back(e->d_name);
+                    }
+                    ::closedir(d);
+                }
+                std::sort(names.begin(), names.end());
+
+                if (mode == mode_t::record)
+                {
+                    std::string joined;
+                    for (const auto &n : names)
+                    {
+                        if (!joined.empty())
+                            joined += '\n';
+                        joined += n;
+                    }
+                    keep_fn('d', dir, std::move(joined));
+                }
+                return names;
+            }
+
+            // Filesystem size in kB
+            bool statvfs_fn(std::string_view point, long &total, long &used)
+            {
+                if (mode == mode_t::replay)
+                {
+                    auto *v = lookup_fn('s', point);
+                    return v && *v && std::sscanf((*v)->c_str(), "%ld %ld", &total, &used) == 2;
+                }
+
+                struct statvfs st;
+                bool ok = ::statvfs(path_fn(point).c_str(), &st) == 0 && st.f_blocks != 0;
+                if (ok)
+                {
+                    total = (long)(st.f_blocks * st.f_frsize / 1024);
+                    used = (long)((st.f_blocks - st.f_bfree) * st.f_frsize / 1024);
+                }
+                keep_fn('s', point, ok ? std::optional<std::string>(std::to_string(total) + " " + std::to_string(used)) : std::nullopt);
+                return ok;
+            }
+
+            // Env vars are always the caller's own, sysroot or not
+            bool env_fn(const char *name, std::string &out)
+            {
+                if (mode == mode_t::replay)
+                {
+                    auto *v = lookup_fn('e', name);
+                    if (!v || !*v)
+                        return false;
+                    out = **v;
+                    return true;
+                }
+                const char *e = std::getenv(name);
+                if (e)
+                    out = e;
+                keep_fn('e', name, e ? std::optional<std::string>(out) : std::nullopt);
+                return e != nullptr;
+            }
+
+            // Commands see the running system, so with a sysroot they are not run at all
+            std::string exec_fn(const std::string &cmd)
+            {
+                if (mode == mode_t::replay)
+                {
+                    auto *v = lookup_fn('x', cmd);
+                    return v && *v ? **v : "";
+                }
+                std::string out = root.empty() ? util_ns::exec_cmd_fn(cmd) : "";
+                keep_fn('x', cmd, out);
+                return out;
+            }
+
+            // Plugins cannot be replayed from their inputs, so their outputs are the input.
+            // Only used in replay; false if the value was not recorded.
+            bool plugin_value_fn(std::string_view key, std::string &out) const
+            {
+                auto *v = lookup_fn('p', key);
+                if (!v || !*v)
+                    return false;
+                out = **v;
+                return true;
+            }
+
+            void record_plugin_fn(std::string_view key, std::optional<std::string> v)
+            {
+                keep_fn('p', key, std::move(v));
+            }
+
+            // -- snapshots --
+
+            void record_fn()
+            {
+                mode = mode_t::record;
+            }
+
+            // Serves what was recorded so far, e.g. to render a --record run from its own snapshot
+            void replay_fn()
+            {
+                mode = mode_t::replay;
+            }
+
+            std::string serialize_fn() const
+            {
+                // sorted so the same inputs give the same bytes
+                std::vector<const std::pair<const std::string, std::optional<std::string>> *> entries;
+                entries.reserve(snap.size());
+                for (const auto &e : snap)
+                    entries.push_back(&e);
+                std::sort(entries.begin(), entries.end(), [](auto *a, auto *b)
+                          { return a->first < b->first; });
+
+                std::string out = "mfetch-snapshot 1\n";
+                for (const auto *e : entries)
+                {
+                    const std::string &k = e->first;
+                    out += k[0];
+                    out += ' ';
+                    out += std::to_string(k.size() - 1);
+                    out += ' ';
+                    out += e->second ? std::to_string(e->second->size()) : "-1";
+                    out += '\n';
+                    out.append(k, 1, std::string::npos);
+                    if (e->second)
+                        out += *e->second;
+                }
+                return out;
+            }
+
+            void save_fn(const std::string &path) const
+            {
+                util_ns::write_file_atomic_fn(path, serialize_fn());
+            }
+
+            // Replaces the snapshot with data and switches to replay
+            void parse_fn(std::string_view data, const std::string &name)
+            {
+                auto bad = [&](const char *why)
+                {
+                    throw std::runtime_error("bad snapshot '" + name + "': " + why);
+                };
+
+                constexpr std::string_view magic = "mfetch-snapshot 1\n";
+                if (data.substr(0, magic.size()) != magic)
+                    bad("not an mfetch snapshot");
+                data.remove_prefix(magic.size());
+
+                snap.clear();
+                while (!data.empty())
+                {
+                    auto nl = data.find('\n');
+                    if (nl == std::string_view::npos)
+                        bad("truncated header");
+                    std::string head(data.substr(0, nl));
+                    data.remove_prefix(nl + 1);
+
+                    char tag;
+                    long klen, vlen;
+                    if (std::sscanf(head.c_str(), "%c %ld %ld", &tag, &klen, &vlen) != 3 || klen < 0 || vlen < -1)
+                        bad("bad record header");
+                    if ((size_t)klen + (size_t)std::max(vlen, 0L) > data.size())
+                        bad("truncated record");
+
+                    std::string_view key = data.substr(0, (size_t)klen);
+                    data.remove_prefix((size_t)klen);
+                    std::optional<std::string> val;
+                    if (vlen >= 0)
+                    {
+                        val = std::string(data.substr(0, (size_t)vlen));
+                        data.remove_prefix((size_t)vlen);
+                    }
+                    snap[snap_key_fn(tag, key)] = std::move(val);
+                }
+                mode = mode_t::replay;
+            }
+
+            void load_fn(const std::string &path)
+            {
+                std::string data;
+                if (!read_live_fn(path, data, SIZE_MAX))
+                    throw std::runtime_error("cannot read snapshot '" + path + "': " + std::strerror(errno));
+                parse_fn(data, path);
+            }
+    };
+} // namespace source_ns
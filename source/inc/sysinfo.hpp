@@ -1,38 +1,98 @@
 #pragma once
 
 #include "util.hpp"
+#include "source.hpp"
 #include <string>
 #include <vector>
-#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string_view>
 
 namespace sysinfo_ns
 {
-
+    // pid's parent, from /proc/<pid>/stat ("self" works too); -1 if unreadable
+    inline long parent_pid_fn(source_ns::source_t &src, const std::string &pid)
+    {
+        std::string stat;
+        if (!src.read_line_fn("/proc/" + pid + "/stat", stat))
+            return -1;
+        // comm may contain spaces and parens, fields resume after the last ')'
+        auto close = stat.rfind(')');
+        if (close == std::string::npos)
+            return -1;
+        char state;
+        long ppid;
+        if (std::sscanf(stat.c_str() + close + 1, " %c %ld", &state, &ppid) != 2)
+            return -1;
+        return ppid;
+    }
+
+    // All reads go through src, so a sysinfo_t can describe a sysroot or a recorded snapshot
     class sysinfo_t
     {
+            source_ns::source_t &src;
+
+            // memory cgroup to report instead of the whole machine
+            source_ns::source_t *cg_src = nullptr;
+            std::string cg_dir;
+            bool cg_v2 = true;
+
         public:
+            explicit sysinfo_t(source_ns::source_t &s) : src(s)
+            {
+            }
+
+            // The running system
             static sysinfo_t &instance_fn()
             {
-                static sysinfo_t instance;
+                static sysinfo_t instance(source_ns::source_t::live_fn());
                 return instance;
             }
 
+            source_ns::source_t &source_fn() const
+            {
+                return src;
+            }
+
+            // Memory from cgroup dir (read through host) instead of /proc/meminfo.
+            // v2: memory.current / memory.max, v1: memory.usage_in_bytes / memory.limit_in_bytes
+            void use_cgroup_fn(source_ns::source_t &host, std::string dir, bool v2)
+            {
+                cg_src = &host;
+                cg_dir = std::move(dir);
+                cg_v2 = v2;
+            }
+
             std::string get_hostname_fn() const
             {
-                return util_ns::exec_cmd_fn("hostname");
+                std::string host;
+                // under a root, /proc/sys still shows the caller's uts namespace
+                bool etc_first = !src.root_fn().empty();
+                if (etc_first && src.read_line_fn("/etc/hostname", host) && !host.empty())
+                    return util_ns::trim_fn(host);
+                if (src.read_line_fn("/proc/sys/kernel/hostname", host) && !host.empty())
+                    return host;
+                if (!etc_first && src.read_line_fn("/etc/hostname", host) && !host.empty())
+                    return util_ns::trim_fn(host);
+                return src.exec_fn("hostname");
             }
 
             std::string get_username_fn() const
             {
-                const char *user = std::getenv("USER");
-                return user ? std::string(user) : util_ns::exec_cmd_fn("whoami");
+                std::string user;
+                return src.env_fn("USER", user) ? user : src.exec_fn("whoami");
             }
 
             std::string get_kernel_fn() const
             {
-                std::string k = util_ns::exec_cmd_fn("uname -r");
+                std::string k;
+                if (!src.read_line_fn("/proc/sys/kernel/osrelease", k) || k.empty())
+                    k = src.exec_fn("uname -r");
                 auto pos = k.find('-');
                 if (pos != std::string::npos)
                     return k.substr(0, pos);
@@ -41,26 +101,53 @@ namespace sysinfo_ns
 
             std::string get_os_fn() const
             {
-                std::ifstream file("/etc/os-release");
-                std::string line;
-                while (std::getline(file, line))
+                std::string data;
+                if (src.read_fn("/etc/os-release", data) || src.read_fn("/usr/lib/os-release", data))
                 {
-                    if (line.rfind("PRETTY_NAME=", 0) == 0)
+                    std::istringstream file(data);
+                    std::string line;
+                    while (std::getline(file, line))
                     {
-                        std::string val = line.substr(12);
-                        if (val.size() >= 2 && val.front() == '"' && val.back() == '"')
-                            val = val.substr(1, val.size() - 2);
-                        return val;
+                        if (line.rfind("PRETTY_NAME=", 0) == 0)
+                        {
+                            std::string val = line.substr(12);
+                            if (val.size() >= 2 && val.front() == '"' && val.back() == '"')
+                                val = val.substr(1, val.size() - 2);
+                            return val;
+                        }
                     }
                 }
-                return util_ns::exec_cmd_fn("uname -o");
+                return src.exec_fn("uname -o");
             }
 
-            std::string get_cpu_fn() const
+            std::string get_kernel_name_fn() const
             {
-                std::string cpu = util_ns::exec_cmd_fn("grep -m1 'model name' /proc/cpuinfo | cut -d: -f2");
-                std::string clean = util_ns::trim_fn(cpu);
+                std::string name;
+                if (src.read_line_fn("/proc/sys/kernel/ostype", name) && !name.empty())
+                    return name;
+                return src.exec_fn("uname -s");
+            }
 
+            // Raw model name, as the vendor spells it
+            std::string get_cpu_model_fn() const
+            {
+                // the first processor block is enough; reading all of cpuinfo
+                // costs a frequency sample per core on x86
+                std::string info;
+                if (!src.read_fn("/proc/cpuinfo", info, 8192))
+                    return "";
+                auto pos = info.find("model name");
+                if (pos == std::string::npos)
+                    return "";
+                auto colon = info.find(':', pos);
+                auto nl = info.find('\n', pos);
+                if (colon == std::string::npos || colon > nl)
+                    return "";
+                return util_ns::trim_fn(info.substr(colon + 1, nl == std::string::npos ? std::string::npos : nl - colon - 1));
+            }
+
+            static std::string clean_cpu_fn(std::string clean)
+            {
                 // replace dashes with spaces
                 std::replace(clean.begin(), clean.end(), '-', ' ');
 
@@ -81,7 +168,6 @@ namespace sysinfo_ns
                 while (ss >> segment)
                 {
                     // Check if segment is a frequency (contains digit and dot)
-                    bool is_freq = false;
                     bool has_dot = (segment.find('.') != std::string::npos);
                     bool has_digit = std::any_of(segment.begin(), segment.end(), ::isdigit);
 
@@ -96,15 +182,41 @@ namespace sysinfo_ns
                 return result;
             }
 
+            std::string get_cpu_fn() const
+            {
+                return clean_cpu_fn(get_cpu_model_fn());
+            }
+
             struct gpu_info_t
             {
-                    std::string name;
+                    std::string name;  // cleaned
+                    std::string model; // raw lspci name
             };
 
+            static std::string clean_gpu_fn(std::string name)
+            {
+                // Clean common junk
+                const std::vector<std::string> junk = {"GeForce", "Mobile", "NVIDIA", "Corporation", "Inc", "geforce", "mobile", "nvidia"};
+                for (const auto &j : junk)
+                {
+                    size_t p;
+                    while ((p = name.find(j)) != std::string::npos)
+                    {
+                        name.erase(p, j.length());
+                    }
+                }
+                // Collapse spaces
+                auto end = std::unique(name.begin(), name.end(), [](char a, char b)
+                                       { return std::isspace(a) && std::isspace(b); });
+                name.erase(end, name.end());
+
+                return util_ns::trim_fn(name);
+            }
+
             std::vector<gpu_info_t> get_gpus_fn() const
             {
                 std::vector<gpu_info_t> gpus;
-                std::string out = util_ns::exec_cmd_fn("lspci | grep -Ei 'vga|3d|display'");
+                std::string out = src.exec_fn("lspci | grep -Ei 'vga|3d|display'");
                 auto lines = util_ns::split_fn(out, '\n');
 
                 for (const auto &line : lines)
@@ -123,27 +235,10 @@ namespace sysinfo_ns
 
                     if (!name.empty())
                     {
-                        // Clean common junk
-                        const std::vector<std::string> junk = {"GeForce", "Mobile", "NVIDIA", "Corporation", "Inc", "geforce", "mobile", "nvidia"};
-                        for (const auto &j : junk)
-                        {
-                            size_t p;
-                            while ((p = name.find(j)) != std::string::npos)
-                            {
-                                name.erase(p, j.length());
-                            }
-                        }
-                        // Collapse spaces
-                        auto end = std::unique(name.begin(), name.end(), [](char a, char b)
-                                               { return std::isspace(a) && std::isspace(b); });
-                        name.erase(end, name.end());
-
-                        name = util_ns::trim_fn(name);
-                        gpus.push_back({name});
+                        std::string model = util_ns::trim_fn(name);
+                        gpus.push_back({clean_gpu_fn(model), model});
                     }
                 }
-                if (gpus.empty())
-                    gpus.push_back({"unknown"});
                 return gpus;
             }
 
@@ -157,7 +252,9 @@ namespace sysinfo_ns
 
             mem_info_t get_mem_fn() const
             {
-                std::ifstream file("/proc/meminfo");
+                std::string data;
+                src.read_fn("/proc/meminfo", data);
+                std::istringstream file(data);
                 std::string key, unit;
                 long val;
                 long total = 0, avail = 0, swap_total = 0, swap_free = 0;
@@ -173,16 +270,48 @@ namespace sysinfo_ns
                     else if (key == "SwapFree:")
                         swap_free = val;
                 }
-                return {total - avail, total, swap_total - swap_free, swap_total};
+                mem_info_t mem{total - avail, total, swap_total - swap_free, swap_total};
+                if (cg_src)
+                    cgroup_mem_fn(mem);
+                return mem;
+            }
+
+            // bytes from a cgroup file in kB; false for "max" or missing
+            bool cgroup_kb_fn(const char *file, long &kb) const
+            {
+                std::string v;
+                if (!cg_src->read_line_fn(cg_dir + "/" + file, v) || v.empty() || v == "max")
+                    return false;
+                long long b = std::atoll(v.c_str());
+                // v1 reports "unlimited" as a huge page-rounded number
+                if (b <= 0 || b >= (1LL << 62))
+                    return false;
+                kb = (long)(b / 1024);
+                return true;
+            }
+
+            void cgroup_mem_fn(mem_info_t &mem) const
+            {
+                long kb;
+                if (cgroup_kb_fn(cg_v2 ? "memory.current" : "memory.usage_in_bytes", kb))
+                    mem.used = kb;
+                if (cgroup_kb_fn(cg_v2 ? "memory.max" : "memory.limit_in_bytes", kb) && kb < mem.total)
+                    mem.total = kb;
+                if (cg_v2)
+                {
+                    if (cgroup_kb_fn("memory.swap.current", kb))
+                        mem.swap_used = kb;
+                    if (cgroup_kb_fn("memory.swap.max", kb) && kb < mem.swap_total)
+                        mem.swap_total = kb;
+                }
             }
 
             std::string get_wm_fn() const
             {
                 // Simple heuristic
-                const char *xdg = std::getenv("XDG_CURRENT_DESKTOP");
-                if (xdg)
+                std::string s;
+                if (src.env_fn("XDG_CURRENT_DESKTOP", s))
                 {
-                    std::string s(xdg);
                     if (s.find("Hyprland") != std::string::npos)
                         return "hyprland";
                     if (s.find("GNOME") != std::string::npos)
@@ -198,29 +327,26 @@ namespace sysinfo_ns
 
             std::string get_de_fn() const
             {
-                const char *hypr_cmd = std::getenv("HYPRLAND_CMD");
-                if (hypr_cmd)
+                std::string v;
+                if (src.env_fn("HYPRLAND_CMD", v))
                 {
-                    std::string cmd = util_ns::to_lower_fn(hypr_cmd);
-                    if (cmd.find("hypryou") != std::string::npos)
+                    if (util_ns::to_lower_fn(v).find("hypryou") != std::string::npos)
                         return "hypryou";
                 }
 
-                const char *de = std::getenv("XDG_SESSION_DESKTOP");
-                if (de)
-                    return util_ns::to_lower_fn(de);
+                if (src.env_fn("XDG_SESSION_DESKTOP", v))
+                    return util_ns::to_lower_fn(v);
 
-                const char *d = std::getenv("DESKTOP_SESSION");
-                if (d)
-                    return util_ns::to_lower_fn(d);
+                if (src.env_fn("DESKTOP_SESSION", v))
+                    return util_ns::to_lower_fn(v);
 
                 return "unknown";
             }
 
             std::string get_shell_fn() const
             {
-                std::string shell = util_ns::exec_cmd_fn("echo $SHELL");
-                if (shell.empty())
+                std::string shell;
+                if (!src.env_fn("SHELL", shell) || shell.empty())
                     return "unknown";
                 std::filesystem::path p(shell);
                 return p.filename().string();
@@ -228,10 +354,16 @@ namespace sysinfo_ns
 
             std::string get_term_fn() const
             {
-                const char *term = std::getenv("TERM_PROGRAM");
-                if (term)
+                std::string term;
+                if (src.env_fn("TERM_PROGRAM", term))
                     return term;
-                std::string comm = util_ns::exec_cmd_fn("ps -p $(ps -p $$ -o ppid=) -o comm=");
+
+                // we run under a shell, the shell under the terminal
+                long shell = parent_pid_fn(src, "self");
+                long emu = shell > 0 ? parent_pid_fn(src, std::to_string(shell)) : -1;
+                std::string comm;
+                if (emu > 0)
+                    src.read_line_fn("/proc/" + std::to_string(emu) + "/comm", comm);
                 return comm.empty() ? "term" : comm;
             }
 
@@ -246,7 +378,7 @@ namespace sysinfo_ns
                 std::vector<pkg_info_t> pkgs;
                 auto check = [&](const std::string &cmd, const std::string &name)
                 {
-                    std::string res = util_ns::exec_cmd_fn(cmd);
+                    std::string res = src.exec_fn(cmd);
                     if (!res.empty())
                     {
                         try
@@ -270,11 +402,265 @@ namespace sysinfo_ns
 
             std::string get_proc_count_fn() const
             {
-                std::string res = util_ns::exec_cmd_fn("ps -e | wc -l");
-                return res.empty() ? "0" : res;
+                // numeric entries in /proc
+                long n = 0;
+                for (const auto &name : src.list_fn("/proc"))
+                {
+                    if (std::all_of(name.begin(), name.end(), ::isdigit))
+                        ++n;
+                }
+                return std::to_string(n);
+            }
+
+            struct mount_info_t
+            {
+                    std::string point;
+                    std::string device;
+                    long used;  // kB
+                    long total; // kB
+            };
+
+            // Block-device backed mounts, one entry per device
+            std::vector<mount_info_t> get_mounts_fn() const
+            {
+                std::vector<mount_info_t> mnts;
+                std::string data;
+                src.read_fn("/proc/mounts", data);
+                std::istringstream file(data);
+                std::string dev, point, rest;
+                while (file >> dev >> point && std::getline(file, rest))
+                {
+                    if (dev.rfind("/dev/", 0) != 0 || dev.rfind("/dev/loop", 0) == 0)
+                        continue;
+                    bool seen = std::any_of(mnts.begin(), mnts.end(), [&](const mount_info_t &m)
+                                            { return m.device == dev; });
+                    if (seen)
+                        continue;
+
+                    long total, used;
+                    if (!src.statvfs_fn(point, total, used))
+                        continue;
+                    mnts.push_back({point, dev, used, total});
+                }
+                return mnts;
+            }
+
+            struct load_info_t
+            {
+                    long one = 0; // x1000
+                    long five = 0;
+                    long fifteen = 0;
+            };
+
+            load_info_t get_load_fn() const
+            {
+                std::string data;
+                src.read_line_fn("/proc/loadavg", data);
+                std::istringstream file(data);
+                double a = 0, b = 0, c = 0;
+                file >> a >> b >> c;
+                return {std::lround(a * 1000), std::lround(b * 1000), std::lround(c * 1000)};
+            }
+
+            long get_uptime_fn() const
+            {
+                std::string data;
+                src.read_line_fn("/proc/uptime", data);
+                std::istringstream file(data);
+                double up = 0;
+                file >> up;
+                return (long)up;
+            }
+
+            // "0-3,8,10-11" -> 7
+            static long cpu_list_count_fn(std::string_view list)
+            {
+                long n = 0;
+                for (const auto &part : util_ns::split_fn(std::string(list), ','))
+                {
+                    long a, b;
+                    int got = std::sscanf(part.c_str(), "%ld-%ld", &a, &b);
+                    if (got == 2 && b >= a)
+                        n += b - a + 1;
+                    else if (got == 1)
+                        ++n;
+                }
+                return n;
             }
 
-        private:
-            sysinfo_t() = default;
+            struct cache_info_t
+            {
+                    std::string name; // L1d, L1i, L2, L3
+                    std::string size; // "48K", "2M"
+                    long kib = 0;     // per instance
+                    long instances = 0;
+            };
+
+            struct topology_t
+            {
+                    long sockets = 0;
+                    long cores = 0;
+                    long threads = 0;
+                    std::string smt;      // on, off, forceoff, notsupported ...
+                    std::string online;   // range list, "0-127"
+                    std::string isolated; // range list, "" if none
+                    std::vector<cache_info_t> caches;
+            };
+
+            // One walk over /sys/devices/system/cpu. Topology files are read once per core
+            // (its siblings are marked as seen) and caches only for cpu0, so the cost
+            // follows the number of cores, not threads x files.
+            topology_t get_topology_fn() const
+            {
+                topology_t t;
+                const std::string base = "/sys/devices/system/cpu";
+                src.read_line_fn(base + "/online", t.online);
+                src.read_line_fn(base + "/isolated", t.isolated);
+                t.threads = cpu_list_count_fn(t.online);
+
+                std::vector<long> cpus;
+                for (const auto &name : src.list_fn(base))
+                {
+                    if (name.size() > 3 && name.compare(0, 3, "cpu") == 0 && std::all_of(name.begin() + 3, name.end(), ::isdigit))
+                        cpus.push_back(std::atol(name.c_str() + 3));
+                }
+                std::sort(cpus.begin(), cpus.end());
+
+                std::vector<bool> seen(cpus.empty() ? 0 : (size_t)cpus.back() + 1);
+                std::vector<long> packages;
+                for (long cpu : cpus)
+                {
+                    if (seen[(size_t)cpu])
+                        continue;
+                    // offline cpus have no topology directory
+                    auto v = src.read_batch_fn(base + "/cpu" + std::to_string(cpu) + "/topology", {"physical_package_id", "core_cpus_list", "thread_siblings_list"});
+                    if (!v[0])
+                        continue;
+                    ++t.cores;
+                    long pkg = std::atol(v[0]->c_str());
+                    if (std::find(packages.begin(), packages.end(), pkg) == packages.end())
+                        packages.push_back(pkg);
+
+                    const auto &siblings = v[1] ? v[1] : v[2];
+                    seen[(size_t)cpu] = true;
+                    if (!siblings)
+                        continue;
+                    for (const auto &part : util_ns::split_fn(util_ns::trim_fn(*siblings), ','))
+                    {
+                        long a, b;
+                        int got = std::sscanf(part.c_str(), "%ld-%ld", &a, &b);
+                        if (got == 1)
+                            b = a;
+                        for (long c = a; got >= 1 && c <= b && c < (long)seen.size(); ++c)
+                            seen[(size_t)c] = true;
+                    }
+                }
+                t.sockets = (long)packages.size();
+                if (!t.threads)
+                    t.threads = (long)cpus.size();
+
+                if (!src.read_line_fn(base + "/smt/control", t.smt) || t.smt.empty())
+                    t.smt = t.cores && t.threads > t.cores ? "on" : "off";
+
+                std::string cdir = base + "/cpu" + std::to_string(cpus.empty() ? 0 : cpus.front()) + "/cache";
+                for (const auto &idx : src.list_fn(cdir))
+                {
+                    if (idx.rfind("index", 0) != 0)
+                        continue;
+                    auto v = src.read_batch_fn(cdir + "/" + idx, {"level", "type", "size", "shared_cpu_list"});
+                    if (!v[0] || !v[1] || !v[2])
+                        continue;
+                    cache_info_t c;
+                    std::string type = util_ns::trim_fn(*v[1]);
+                    c.name = "L" + util_ns::trim_fn(*v[0]);
+                    if (type == "Data")
+                        c.name += "d";
+                    else if (type == "Instruction")
+                        c.name += "i";
+                    std::string size = util_ns::trim_fn(*v[2]);
+                    c.kib = std::atol(size.c_str());
+                    if (!size.empty() && size.back() == 'M')
+                        c.kib *= 1024;
+                    // sysfs says "2048K"
+                    c.size = c.kib >= 1024 && c.kib % 1024 == 0 ? std::to_string(c.kib / 1024) + "M" : std::to_string(c.kib) + "K";
+                    long sharing = v[3] ? cpu_list_count_fn(util_ns::trim_fn(*v[3])) : 0;
+                    c.instances = sharing > 0 ? (t.threads + sharing - 1) / sharing : 0;
+                    t.caches.push_back(std::move(c));
+                }
+                std::sort(t.caches.begin(), t.caches.end(), [](const cache_info_t &a, const cache_info_t &b)
+                          { return a.name < b.name; });
+                return t;
+            }
+
+            struct numa_node_t
+            {
+                    long id = 0;
+                    std::string cpus; // range list
+                    long mem_used = 0;  // kB
+                    long mem_total = 0; // kB
+            };
+
+            std::vector<numa_node_t> get_numa_fn() const
+            {
+                std::vector<numa_node_t> nodes;
+                const std::string base = "/sys/devices/system/node";
+                for (const auto &name : src.list_fn(base))
+                {
+                    if (name.size() <= 4 || name.compare(0, 4, "node") != 0 || !std::all_of(name.begin() + 4, name.end(), ::isdigit))
+                        continue;
+                    auto v = src.read_batch_fn(base + "/" + name, {"cpulist", "meminfo"}, 8192);
+                    numa_node_t n;
+                    n.id = std::atol(name.c_str() + 4);
+                    if (v[0])
+                        n.cpus = util_ns::trim_fn(*v[0]);
+                    if (v[1])
+                    {
+                        // "Node 0 MemTotal:   16303344 kB"
+                        long free = -1, used = -1;
+                        for (const auto &line : util_ns::split_fn(*v[1], '\n'))
+                        {
+                            long node, kb;
+                            char field[32];
+                            if (std::sscanf(line.c_str(), "Node %ld %31[^:]: %ld", &node, field, &kb) != 3)
+                                continue;
+                            if (std::strcmp(field, "MemTotal") == 0)
+                                n.mem_total = kb;
+                            else if (std::strcmp(field, "MemFree") == 0)
+                                free = kb;
+                            else if (std::strcmp(field, "MemUsed") == 0)
+                                used = kb;
+                        }
+                        n.mem_used = used >= 0 ? used : free >= 0 ? n.mem_total - free : 0;
+                    }
+                    nodes.push_back(std::move(n));
+                }
+                std::sort(nodes.begin(), nodes.end(), [](const numa_node_t &a, const numa_node_t &b)
+                          { return a.id < b.id; });
+                return nodes;
+            }
+
+            struct temp_info_t
+            {
+                    std::string zone;
+                    long milli_c;
+            };
+
+            std::vector<temp_info_t> get_temps_fn() const
+            {
+                std::vector<temp_info_t> temps;
+                for (const auto &name : src.list_fn("/sys/class/thermal"))
+                {
+                    if (name.rfind("thermal_zone", 0) != 0)
+                        continue;
+
+                    std::string dir = "/sys/class/thermal/" + name;
+                    std::string type, temp;
+                    if (src.read_line_fn(dir + "/type", type) && src.read_line_fn(dir + "/temp", temp) && !temp.empty())
+                        temps.push_back({type.empty() ? name : type, std::atol(temp.c_str())});
+                }
+                std::sort(temps.begin(), temps.end(), [](const temp_info_t &a, const temp_info_t &b)
+                          { return a.zone < b.zone; });
+                return temps;
+            }
     };
 } // namespace sysinfo_ns
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+
+// Scoped wall-clock timings for --timings / --trace.
+//
+//   MFETCH_SCOPE("probe:mem");
+//   MFETCH_SCOPE_D("exec", cmd.c_str());
+//
+// Build with -DMFETCH_NO_TIMINGS and the macros expand to nothing and
+// enabled_fn() is a constant false, so guarded code is dropped too.
+namespace timing_ns
+{
+    using steady_t = std::chrono::steady_clock;
+
+    struct event_t
+    {
+            const char *name;
+            std::string detail;
+            int64_t start_ns;
+            int64_t dur_ns;
+            uint32_t tid;
+    };
+
+#ifndef MFETCH_NO_TIMINGS
+    class recorder_t
+    {
+            std::mutex mtx;
+            std::vector<event_t> events;
+            steady_t::time_point t0 = steady_t::now();
+
+            recorder_t() = default;
+
+        public:
+            std::atomic<bool> enabled{false};
+
+            static recorder_t &instance_fn()
+            {
+                static recorder_t instance;
+                return instance;
+            }
+
+            int64_t since_start_ns_fn(steady_t::time_point t) const
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(t - t0).count();
+            }
+
+            void push_fn(event_t e)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                events.push_back(std::move(e));
+            }
+
+            std::vector<event_t> take_fn()
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                return std::move(events);
+            }
+    };
+
+    inline bool enabled_fn()
+    {
+        return recorder_t::instance_fn().enabled.load(std::memory_order_relaxed);
+    }
+
+    inline void enable_fn()
+    {
+        recorder_t::instance_fn().enabled = true;
+    }
+
+    inline std::vector<event_t> take_fn()
+    {
+        return recorder_t::instance_fn().take_fn();
+    }
+
+    inline uint32_t tid_fn()
+    {
+        static std::atomic<uint32_t> next{0};
+        thread_local uint32_t tid = next++;
+        return tid;
+    }
+
+    class scope_t
+    {
+            const char *name;
+            const char *detail;
+            steady_t::time_point start;
+            bool on;
+
+        public:
+            explicit scope_t(const char *n, const char *d = nullptr) : name(n), detail(d), on(enabled_fn())
+            {
+                if (on)
+                    start = steady_t::now();
+            }
+
+            ~scope_t()
+            {
+                if (!on)
+                    return;
+                auto &r = recorder_t::instance_fn();
+                auto end = steady_t::now();
+                r.push_fn({name, detail ? detail : "", r.since_start_ns_fn(start), std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), tid_fn()});
+            }
+
+            scope_t(const scope_t &) = delete;
+            scope_t &operator=(const scope_t &) = delete;
+    };
+
+    // Records a span measured by hand (fork/exec/wait split)
+    inline void span_fn(const char *name, const char *detail, steady_t::time_point start, steady_t::time_point end)
+    {
+        auto &r = recorder_t::instance_fn();
+        r.push_fn({name, detail ? detail : "", r.since_start_ns_fn(start), std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), tid_fn()});
+    }
+
+#    define MFETCH_CAT2(a, b) a##b
+#    define MFETCH_CAT(a, b) MFETCH_CAT2(a, b)
+#    define MFETCH_SCOPE(name) timing_ns::scope_t MFETCH_CAT(mfetch_scope_, __LINE__)(name)
+#    define MFETCH_SCOPE_D(name, detail) timing_ns::scope_t MFETCH_CAT(mfetch_scope_, __LINE__)(name, detail)
+#else
+    constexpr bool enabled_fn()
+    {
+        return false;
+    }
+
+    inline void enable_fn()
+    {
+    }
+
+    inline std::vector<event_t> take_fn()
+    {
+        return {};
+    }
+
+    inline void span_fn(const char *, const char *, steady_t::time_point, steady_t::time_point)
+    {
+    }
+
+#    define MFETCH_SCOPE(name) ((void)0)
+#    define MFETCH_SCOPE_D(name, detail) ((void)0)
+#endif
+
+    // Sorted table on stderr: per name totals, worst first
+    inline void report_fn(const std::vector<event_t> &events, std::ostream &os)
+    {
+        struct row_t
+        {
+                int64_t total = 0;
+                int64_t max = 0;
+                size_t count = 0;
+                std::string worst;
+        };
+        std::map<std::string, row_t> rows;
+        for (const auto &e : events)
+        {
+            auto &r = rows[e.name];
+            r.total += e.dur_ns;
+            r.count++;
+            if (e.dur_ns >= r.max)
+            {
+                r.max = e.dur_ns;
+                r.worst = e.detail;
+            }
+        }
+
+        std::vector<std::pair<std::string, row_t>> sorted(rows.begin(), rows.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b)
+                  { return a.second.total > b.second.total; });
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-20s %6s %11s %11s  %s\n", "scope", "count", "total ms", "max ms", "slowest");
+        os << line;
+        for (const auto &[name, r] : sorted)
+        {
+            std::snprintf(line, sizeof(line), "%-20s %6zu %11.3f %11.3f  %.80s\n", name.c_str(), r.count, r.total / 1e6, r.max / 1e6, r.worst.c_str());
+            os << line;
+        }
+    }
+
+    // Chrome trace-event JSON, loads in Perfetto / chrome://tracing
+    inline std::string trace_json_fn(const std::vector<event_t> &events)
+    {
+        auto esc = [](std::string &out, const std::string &s)
+        {
+            for (unsigned char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    out += '\\';
+                if (c < 0x20)
+                {
+                    char u[8];
+                    std::snprintf(u, sizeof(u), "\\u%04x", c);
+                    out += u;
+                    continue;
+                }
+                out += (char)c;
+            }
+        };
+
+        std::string out = "{\"traceEvents\":[\n";
+        char num[96];
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            const auto &e = events[i];
+            out += "{\"name\":\"";
+            esc(out, e.name);
+            out += "\",\"cat\":\"mfetch\",\"ph\":\"X\"";
+            std::snprintf(num, sizeof(num), ",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u", e.start_ns / 1e3, e.dur_ns / 1e3, (int)getpid(), e.tid);
+            out += num;
+            if (!e.detail.empty())
+            {
+                out += ",\"args\":{\"detail\":\"";
+                esc(out, e.detail);
+                out += "\"}";
+            }
+            out += (i + 1 < events.size()) ? "},\n" : "}\n";
+        }
+        out += "],\"displayTimeUnit\":\"ms\"}\n";
+        return out;
+    }
+} // namespace timing_ns
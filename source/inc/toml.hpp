@@ -0,0 +1,508 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The TOML subset mfetch configs use, in one pass over a mapped file:
+//
+//   [table]  [[array.of.tables]]  key = value  # comments
+//   values: "basic" 'literal' """multi-line basic""" '''multi-line literal''',
+//           integers (+/-, _ separators), true/false
+//
+// Nothing is copied while parsing: keys and values are views into the buffer and
+// strings are only unescaped when the caller asks for them. Floats, dates, arrays,
+// inline tables and dotted keys are reported as errors rather than skipped.
+namespace toml_ns
+{
+    struct pos_t
+    {
+            size_t line = 1;
+            size_t col = 1; // in code points
+    };
+
+    enum class kind_t : uint8_t
+    {
+        string,
+        integer,
+        boolean,
+    };
+
+    struct value_t
+    {
+            kind_t kind = kind_t::string;
+            std::string_view raw; // string body between the quotes
+            bool escaped = false; // basic string with at least one backslash
+            bool multiline = false;
+            long long integer = 0;
+            bool boolean = false;
+            pos_t pos;
+
+            const char *kind_name_fn() const
+            {
+                return kind == kind_t::string ? "a string" : kind == kind_t::integer ? "an integer"
+                                                                                      : "a boolean";
+            }
+
+            // Decoded string; escapes were validated by the parser
+            std::string str_fn() const
+            {
+                if (!escaped)
+                    return std::string(raw);
+
+                std::string out;
+                out.reserve(raw.size());
+                for (size_t i = 0; i < raw.size(); ++i)
+                {
+                    if (raw[i] != '\\')
+                    {
+                        out += raw[i];
+                        continue;
+                    }
+                    char e = raw[++i];
+                    switch (e)
+                    {
+                        case 'b':
+                            out += '\b';
+                            break;
+                        case 't':
+                            out += '\t';
+                            break;
+                        case 'n':
+                            out += '\n';
+                            break;
+                        case 'f':
+                            out += '\f';
+                            break;
+                        case 'r':
+                            out += '\r';
+                            break;
+                        case '"':
+                        case '\\':
+                            out += e;
+                            break;
+                        case 'u':
+                        case 'U':
+                        {
+                            size_t n = e == 'u' ? 4 : 8;
+                            unsigned long cp = std::stoul(std::string(raw.substr(i + 1, n)), nullptr, 16);
+                            i += n;
+                            if (cp < 0x80)
+                                out += (char)cp;
+                            else if (cp < 0x800)
+                            {
+                                out += (char)(0xc0 | (cp >> 6));
+                                out += (char)(0x80 | (cp & 0x3f));
+                            }
+                            else if (cp < 0x10000)
+                            {
+                                out += (char)(0xe0 | (cp >> 12));
+                                out += (char)(0x80 | ((cp >> 6) & 0x3f));
+                                out += (char)(0x80 | (cp & 0x3f));
+                            }
+                            else
+                            {
+                                out += (char)(0xf0 | (cp >> 18));
+                                out += (char)(0x80 | ((cp >> 12) & 0x3f));
+                                out += (char)(0x80 | ((cp >> 6) & 0x3f));
+                                out += (char)(0x80 | (cp & 0x3f));
+                            }
+                            break;
+                        }
+                        default:
+                            // line-ending backslash in a multi-line string: drop it and the whitespace after
+                            while (i + 1 < raw.size() && std::strchr(" \t\r\n", raw[i + 1]))
+                                ++i;
+                            break;
+                    }
+                }
+                return out;
+            }
+    };
+
+    // Read-only mapping of a whole file, unmapped on destruction
+    class mapped_file_t
+    {
+            void *addr = MAP_FAILED;
+            size_t len = 0;
+
+        public:
+            mapped_file_t() = default;
+            mapped_file_t(const mapped_file_t &) = delete;
+            mapped_file_t &operator=(const mapped_file_t &) = delete;
+
+            ~mapped_file_t()
+            {
+                if (addr != MAP_FAILED)
+                    ::munmap(addr, len);
+            }
+
+            // false if the file cannot be opened or mapped
+            bool open_fn(const std::string &path)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return false;
+                struct stat st;
+                bool ok = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+                if (ok && st.st_size > 0)
+                {
+                    len = (size_t)st.st_size;
+                    addr = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+                    ok = addr != MAP_FAILED;
+                }
+                ::close(fd);
+                return ok;
+            }
+
+            std::string_view view_fn() const
+            {
+                return addr == MAP_FAILED ? std::string_view() : std::string_view((const char *)addr, len);
+            }
+    };
+
+    // "name:line:col"
+    inline std::string where_fn(const std::string &name, pos_t p)
+    {
+        return name + ":" + std::to_string(p.line) + ":" + std::to_string(p.col);
+    }
+
+    [[noreturn]] inline void error_fn(const std::string &name, pos_t p, const std::string &msg)
+    {
+        throw std::runtime_error(where_fn(name, p) + ": " + msg);
+    }
+
+    inline void warn_fn(const std::string &name, pos_t p, const std::string &msg)
+    {
+        std::cerr << "mfetch: " << where_fn(name, p) << ": " << msg << "\n";
+    }
+
+    // Handler:
+    //   void table_fn(std::string_view name, bool array, pos_t)
+    //   void value_fn(std::string_view key, pos_t key_pos, const value_t &)
+    // Keys before the first header belong to the root table, name "".
+    template <typename handler_t>
+    class parser_t
+    {
+            std::string_view doc;
+            const std::string &name;
+            handler_t &h;
+            size_t i = 0;
+            size_t line = 1;
+            size_t line_start = 0;
+
+            std::vector<std::string_view> keys;   // of the current table, for duplicates
+            std::vector<std::string_view> tables; // plain [tables] seen so far
+
+            bool eof_fn() const
+            {
+                return i >= doc.size();
+            }
+
+            pos_t pos_fn(size_t at) const
+            {
+                pos_t p;
+                p.line = line;
+                size_t from = line_start;
+                if (at < line_start)
+                {
+                    // an earlier line, only on errors (unterminated strings)
+                    p.line = 1 + (size_t)std::count(doc.begin(), doc.begin() + at, '\n');
+                    from = doc.rfind('\n', at ? at - 1 : 0);
+                    from = from == std::string_view::npos || from >= at ? 0 : from + 1;
+                }
+                for (size_t k = from; k < at && k < doc.size(); ++k)
+                {
+                    if (((unsigned char)doc[k] & 0xc0) != 0x80)
+                        ++p.col;
+                }
+                return p;
+            }
+
+            [[noreturn]] void fail_fn(size_t at, const std::string &msg) const
+            {
+                error_fn(name, pos_fn(at), msg);
+            }
+
+            void skip_ws_fn()
+            {
+                while (!eof_fn() && (doc[i] == ' ' || doc[i] == '\t'))
+                    ++i;
+            }
+
+            // at a newline: consume it (\n or \r\n)
+            bool newline_fn()
+            {
+                if (!eof_fn() && doc[i] == '\n')
+                    ++i;
+                else if (doc.substr(i, 2) == "\r\n")
+                    i += 2;
+                else
+                    return false;
+                ++line;
+                line_start = i;
+                return true;
+            }
+
+            // whitespace, an optional comment, then a newline or the end
+            void end_of_line_fn()
+            {
+                skip_ws_fn();
+                if (!eof_fn() && doc[i] == '#')
+                {
+                    while (!eof_fn() && doc[i] != '\n')
+                        ++i;
+                }
+                if (!eof_fn() && !newline_fn())
+                    fail_fn(i, std::string("expected the end of the line, found '") + doc[i] + "'");
+            }
+
+            static bool bare_fn(char c)
+            {
+                return std::isalnum((unsigned char)c) || c == '_' || c == '-';
+            }
+
+            // the body between the quotes; i ends after the closing quote
+            std::string_view string_fn(char q, bool multi, bool &escaped)
+            {
+                size_t open = i;
+                i += multi ? 3 : 1;
+                if (multi)
+                    newline_fn(); // a newline right after the opening quotes is not part of the string
+                size_t start = i;
+                escaped = false;
+
+                for (;;)
+                {
+                    if (eof_fn())
+                        fail_fn(open, "unterminated string");
+                    char c = doc[i];
+                    if (c == q && (!multi || doc.substr(i, 3) == std::string(3, q)))
+                    {
+                        size_t end = i;
+                        if (multi)
+                        {
+                            // up to two quotes may sit right before the closing three
+                            size_t extra = 0;
+                            while (extra < 2 && i + 3 + extra < doc.size() && doc[i + 3 + extra] == q)
+                                ++extra;
+                            end += extra;
+                            i += 3 + extra;
+                        }
+                        else
+                            ++i;
+                        return doc.substr(start, end - start);
+                    }
+                    if (c == '\n' || c == '\r')
+                    {
+                        if (!multi)
+                            fail_fn(i, "newline in a single-line string");
+                        if (!newline_fn())
+                            ++i;
+                        continue;
+                    }
+                    if (c == '\\' && q == '"')
+                    {
+                        escaped = true;
+                        size_t esc = i++;
+                        if (eof_fn())
+                            fail_fn(open, "unterminated string");
+                        char e = doc[i];
+                        if (e == 'u' || e == 'U')
+                        {
+                            size_t n = e == 'u' ? 4 : 8;
+                            for (size_t k = 1; k <= n; ++k)
+                            {
+                                if (i + k >= doc.size() || !std::isxdigit((unsigned char)doc[i + k]))
+                                    fail_fn(esc, "bad unicode escape");
+                            }
+                            i += n + 1;
+                        }
+                        else if (std::strchr("btnfr\"\\", e))
+                            ++i;
+                        else if (multi && (e == ' ' || e == '\t' || e == '\n' || e == '\r'))
+                        {
+                            // line-ending backslash; only whitespace may follow it on the line
+                            skip_ws_fn();
+                            if (!newline_fn())
+                                fail_fn(esc, "unknown escape '\\" + std::string(1, e) + "'");
+                        }
+                        else
+                            fail_fn(esc, "unknown escape '\\" + std::string(1, e) + "'");
+                        continue;
+                    }
+                    ++i;
+                }
+            }
+
+            std::string_view key_fn(size_t &at)
+            {
+                at = i;
+                std::string_view k;
+                if (!eof_fn() && (doc[i] == '"' || doc[i] == '\''))
+                {
+                    bool escaped;
+                    k = string_fn(doc[i], false, escaped);
+                    if (escaped)
+                        fail_fn(at, "escapes in keys are not supported");
+                }
+                else
+                {
+                    size_t s = i;
+                    while (!eof_fn() && bare_fn(doc[i]))
+                        ++i;
+                    if (i == s)
+                        fail_fn(i, "expected a key");
+                    k = doc.substr(s, i - s);
+                }
+                skip_ws_fn();
+                if (!eof_fn() && doc[i] == '.')
+                    fail_fn(i, "dotted keys are not supported");
+                return k;
+            }
+
+            value_t value_fn()
+            {
+                value_t v;
+                size_t at = i;
+                v.pos = pos_fn(at);
+                if (eof_fn() || doc[i] == '\n' || doc[i] == '\r' || doc[i] == '#')
+                    fail_fn(i, "expected a value");
+
+                char c = doc[i];
+                if (c == '"' || c == '\'')
+                {
+                    v.multiline = doc.substr(i, 3) == std::string(3, c);
+                    v.raw = string_fn(c, v.multiline, v.escaped);
+                    return v;
+                }
+                if (doc.substr(i, 4) == "true" || doc.substr(i, 5) == "false")
+                {
+                    v.kind = kind_t::boolean;
+                    v.boolean = c == 't';
+                    i += v.boolean ? 4 : 5;
+                }
+                else if (c == '+' || c == '-' || std::isdigit((unsigned char)c))
+                {
+                    v.kind = kind_t::integer;
+                    size_t s = i;
+                    bool neg = c == '-';
+                    if (c == '+' || c == '-')
+                        ++i;
+                    unsigned long long n = 0;
+                    bool digit = false;
+                    while (!eof_fn() && (std::isdigit((unsigned char)doc[i]) || (doc[i] == '_' && digit)))
+                    {
+                        if (doc[i] != '_')
+                        {
+                            n = n * 10 + (unsigned long long)(doc[i] - '0');
+                            if (n > (unsigned long long)LLONG_MAX + 1)
+                                fail_fn(s, "integer out of range");
+                            digit = true;
+                        }
+                        ++i;
+                    }
+                    if (!digit || doc[i - 1] == '_')
+                        fail_fn(s, "bad integer");
+                    if (!neg && n > (unsigned long long)LLONG_MAX)
+                        fail_fn(s, "integer out of range");
+                    v.integer = neg ? (long long)(0 - n) : (long long)n;
+                }
+                else if (c == '[' || c == '{')
+                    fail_fn(i, c == '[' ? "arrays are not supported" : "inline tables are not supported");
+                else
+                    fail_fn(i, "expected a value");
+
+                // 1.5, 1e3, 1979-05-27, truex ...
+                if (!eof_fn() && !std::strchr(" \t\r\n#", doc[i]))
+                    fail_fn(at, "unsupported value");
+                return v;
+            }
+
+            void header_fn()
+            {
+                size_t at = i;
+                bool array = doc.substr(i, 2) == "[[";
+                i += array ? 2 : 1;
+                skip_ws_fn();
+                size_t s = i;
+                while (!eof_fn() && (bare_fn(doc[i]) || doc[i] == '.'))
+                    ++i;
+                std::string_view tname = doc.substr(s, i - s);
+                if (tname.empty())
+                    fail_fn(s, "expected a table name");
+                skip_ws_fn();
+                if (doc.substr(i, array ? 2 : 1) != (array ? "]]" : "]"))
+                    fail_fn(i, array ? "expected ']]'" : "expected ']'");
+                i += array ? 2 : 1;
+
+                if (!array)
+                {
+                    if (std::find(tables.begin(), tables.end(), tname) != tables.end())
+                        fail_fn(at, "table [" + std::string(tname) + "] defined twice");
+                    tables.push_back(tname);
+                }
+                keys.clear();
+                h.table_fn(tname, array, pos_fn(at));
+            }
+
+        public:
+            parser_t(std::string_view d, const std::string &n, handler_t &handler) : doc(d), name(n), h(handler)
+            {
+            }
+
+            void run_fn()
+            {
+                if (doc.substr(0, 3) == "\xef\xbb\xbf") // BOM
+                    i = line_start = 3;
+
+                while (true)
+                {
+                    skip_ws_fn();
+                    if (eof_fn())
+                        break;
+                    char c = doc[i];
+                    if (c == '#' || c == '\n' || c == '\r')
+                    {
+                        end_of_line_fn();
+                        continue;
+                    }
+
+                    if (c == '[')
+                        header_fn();
+                    else
+                    {
+                        size_t at;
+                        std::string_view k = key_fn(at);
+                        if (eof_fn() || doc[i] != '=')
+                            fail_fn(i, "expected '=' after '" + std::string(k) + "'");
+                        ++i;
+                        skip_ws_fn();
+                        pos_t kpos = pos_fn(at);
+                        value_t v = value_fn();
+                        if (std::find(keys.begin(), keys.end(), k) != keys.end())
+                            error_fn(name, kpos, "duplicate key '" + std::string(k) + "'");
+                        keys.push_back(k);
+                        h.value_fn(k, kpos, v);
+                    }
+                    end_of_line_fn();
+                }
+            }
+    };
+
+    template <typename handler_t>
+    inline void parse_fn(std::string_view doc, const std::string &name, handler_t &h)
+    {
+        parser_t<handler_t> p(doc, name, h);
+        p.run_fn();
+    }
+} // namespace toml_ns
@@ -8,8 +8,16 @@
 #include <memory>
 #include <array>
 #include <iostream>
-#include <iomanip>
 #include <unordered_map>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "timing.hpp"
 
 namespace util_ns
 {
@@ -40,24 +48,122 @@ namespace util_ns
         return s.substr(str_begin, str_range);
     }
 
+    // Runs cmd through /bin/sh with stderr discarded, returns trimmed stdout.
+    // Hand-rolled instead of popen so --timings can split fork, exec and wait.
     inline std::string exec_cmd_fn(const std::string &cmd)
     {
-        std::array<char, 128> buffer;
-        std::string result;
-        // Use a safe wrapper or assume popen works enough
-        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen((cmd + " 2>/dev/null").c_str(), "r"), pclose);
+        MFETCH_SCOPE_D("exec", cmd.c_str());
+        const bool timed = timing_ns::enabled_fn();
 
-        if (!pipe)
+        int out_fd[2];
+        if (pipe2(out_fd, O_CLOEXEC) != 0)
             return "";
 
-        while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
+        // closes on successful exec, carries errno otherwise; only needed to time exec
+        int st_fd[2] = {-1, -1};
+        if (timed && pipe2(st_fd, O_CLOEXEC) != 0)
+            st_fd[0] = st_fd[1] = -1;
+
+        auto t_fork = timed ? timing_ns::steady_t::now() : timing_ns::steady_t::time_point{};
+        pid_t pid = fork();
+        if (pid < 0)
         {
-            result += buffer.data();
+            close(out_fd[0]);
+            close(out_fd[1]);
+            if (st_fd[0] >= 0)
+            {
+                close(st_fd[0]);
+                close(st_fd[1]);
+            }
+            return "";
+        }
+        if (pid == 0)
+        {
+            dup2(out_fd[1], STDOUT_FILENO);
+            // O_CLOEXEC so only the dup on fd 2 reaches the command (dup2 clears the flag there)
+            int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            if (devnull == STDERR_FILENO)
+                fcntl(devnull, F_SETFD, 0);
+            else if (devnull >= 0)
+                dup2(devnull, STDERR_FILENO);
+            execl("/bin/sh", "sh", "-c", cmd.c_str(), (char *)nullptr);
+            int err = errno;
+            if (st_fd[1] >= 0)
+            {
+                ssize_t w = write(st_fd[1], &err, sizeof(err));
+                (void)w;
+            }
+            _exit(127);
+        }
+
+        auto t_exec = timed ? timing_ns::steady_t::now() : timing_ns::steady_t::time_point{};
+        close(out_fd[1]);
+        if (st_fd[0] >= 0)
+        {
+            close(st_fd[1]);
+            int err;
+            while (read(st_fd[0], &err, sizeof(err)) < 0 && errno == EINTR)
+            {
+            }
+            close(st_fd[0]);
+        }
+
+        auto t_wait = timed ? timing_ns::steady_t::now() : timing_ns::steady_t::time_point{};
+        std::string result;
+        std::array<char, 4096> buffer;
+        for (;;)
+        {
+            ssize_t n = read(out_fd[0], buffer.data(), buffer.size());
+            if (n > 0)
+                result.append(buffer.data(), (size_t)n);
+            else if (n == 0 || errno != EINTR)
+                break;
+        }
+        close(out_fd[0]);
+        int status;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+
+        if (timed)
+        {
+            auto t_done = timing_ns::steady_t::now();
+            timing_ns::span_fn("exec:fork", cmd.c_str(), t_fork, t_exec);
+            timing_ns::span_fn("exec:exec", cmd.c_str(), t_exec, t_wait);
+            timing_ns::span_fn("exec:wait", cmd.c_str(), t_wait, t_done);
         }
 
         return trim_fn(result);
     }
 
+    // Writes via a temp file in the same directory and rename(),
+    // so readers never see a half-written file
+    inline void write_file_atomic_fn(const std::string &path, const std::string &data)
+    {
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        FILE *f = std::fopen(tmp.c_str(), "wb");
+        if (!f)
+            throw std::runtime_error("cannot write '" + tmp + "': " + std::strerror(errno));
+
+        bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+        ok = (std::fclose(f) == 0) && ok;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            int err = errno;
+            std::remove(tmp.c_str());
+            throw std::runtime_error("cannot write '" + path + "': " + std::strerror(err));
+        }
+    }
+
+    // $XDG_CACHE_HOME/mfetch, or ~/.cache/mfetch
+    inline std::string cache_dir_fn()
+    {
+        if (const char *x = std::getenv("XDG_CACHE_HOME"); x && *x)
+            return std::string(x) + "/mfetch";
+        const char *home = std::getenv("HOME");
+        return std::string(home ? home : "") + "/.cache/mfetch";
+    }
+
     inline std::vector<std::string> split_fn(const std::string &s, char delimiter)
     {
         std::vector<std::string> tokens;
@@ -82,10 +188,11 @@ namespace util_ns
         return 0;
     }
 
-    inline std::string color_fn(const std::string &text, const std::string &style_str)
+    // Escape sequence for a style string ("bold #ff00aa"), empty if it sets nothing
+    inline std::string sgr_fn(const std::string &style_str)
     {
         if (style_str.empty())
-            return text;
+            return "";
 
         std::string ansi = "";
         std::string s = to_lower_fn(style_str);
@@ -144,8 +251,17 @@ namespace util_ns
         if (!ansi.empty() && ansi.back() == ';')
             ansi.pop_back(); // Remove trailing ;
         if (ansi.empty())
+            return "";
+
+        return "\033[" + ansi + "m";
+    }
+
+    inline std::string color_fn(const std::string &text, const std::string &style_str)
+    {
+        std::string sgr = sgr_fn(style_str);
+        if (sgr.empty())
             return text;
 
-        return "\033[" + ansi + "m" + text + "\033[0m";
+        return sgr + text + "\033[0m";
     }
 } // namespace util_ns
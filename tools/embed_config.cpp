@@ -0,0 +1,129 @@
+// Compiles a config into a header of constexpr data, for builds with -DMFETCH_EMBEDDED_CONFIG.
+//
+//   mfetch-embed CONFIG OUT
+//
+// CONFIG goes through the same loader mfetch uses, so errors and warnings are the
+// ones mfetch would print at runtime. Art line widths are measured here once.
+// `task build-embedded` runs this and builds mfetch against the result.
+
+#include "../source/inc/config.hpp"
+#include "../source/inc/layout.hpp"
+#include "../source/inc/util.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    // C++ string literal; octal escapes never swallow the next character
+    std::string literal_fn(std::string_view s)
+    {
+        std::string out = "\"";
+        for (unsigned char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += (char)c;
+            }
+            else if (c == '\n')
+                out += "\\n";
+            else if (c < 0x20 || c == 0x7f)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\%03o", c);
+                out += buf;
+            }
+            else
+                out += (char)c; // UTF-8 art stays readable
+        }
+        return out + "\"";
+    }
+
+    std::string int_fn(const char *name, int v)
+    {
+        return "    inline constexpr int " + std::string(name) + " = " + std::to_string(v) + ";\n";
+    }
+
+    std::string str_fn(const char *name, std::string_view v)
+    {
+        return "    inline constexpr std::string_view " + std::string(name) + " = " + literal_fn(v) + ";\n";
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "usage: mfetch-embed CONFIG OUT\n");
+        return 2;
+    }
+    std::string path = argv[1];
+
+    try
+    {
+        if (!std::filesystem::exists(path))
+        {
+            std::fprintf(stderr, "mfetch-embed: cannot access '%s'\n", path.c_str());
+            return 1;
+        }
+        config_ns::config_t cfg = config_ns::load_config_fn(path);
+
+        std::string out;
+        out += "// Generated by mfetch-embed from " + path + " - do not edit\n";
+        out += "#pragma once\n\n#include <array>\n#include <string_view>\n\n";
+        out += "namespace config_ns::embedded_ns\n{\n";
+        out += str_fn("origin", path);
+        out += "\n";
+
+        auto lines = util_ns::split_fn(cfg.ascii_art, '\n');
+        out += str_fn("ascii_art", cfg.ascii_art);
+        out += "    inline constexpr std::array<size_t, " + std::to_string(lines.size()) + "> art_widths = {{";
+        for (size_t i = 0; i < lines.size(); ++i)
+            out += (i ? ", " : "") + std::to_string(layout_ns::visible_len_fn(lines[i]));
+        out += "}};\n";
+        out += str_fn("ascii_position", cfg.ascii_position);
+        out += int_fn("ascii_margin", cfg.ascii_margin);
+        out += int_fn("ascii_min_width", cfg.ascii_min_width);
+        out += int_fn("gap_size", cfg.gap_size);
+        out += "\n";
+
+        out += int_fn("top_padding", cfg.top_padding);
+        out += int_fn("bottom_padding", cfg.bottom_padding);
+        out += int_fn("display_indent", cfg.display_indent);
+        out += int_fn("indent_multiplier", cfg.indent_multiplier);
+        out += str_fn("unit", cfg.unit);
+        out += "\n";
+
+        out += str_fn("image_path", cfg.image_path);
+        out += int_fn("image_width", cfg.image_width);
+        out += int_fn("image_height", cfg.image_height);
+        out += str_fn("image_protocol", cfg.image_protocol);
+        out += "\n";
+
+        out += "    inline constexpr std::array<embedded_module_t, " + std::to_string(cfg.modules.size()) + "> modules = {{\n";
+        for (const auto &m : cfg.modules)
+        {
+            out += "        {" + literal_fn(m.type) + ", " + literal_fn(m.format) + ", " + literal_fn(m.label) + ", " + literal_fn(m.color) + ", " +
+                   literal_fn(m.color_label) + ", " + literal_fn(m.color_out) + ", " + std::to_string(m.indent) + "},\n";
+        }
+        out += "    }};\n";
+
+        out += "    inline constexpr std::array<embedded_format_t, " + std::to_string(cfg.formats.size()) + "> formats = {{\n";
+        for (const auto &f : cfg.formats)
+            out += "        {" + literal_fn(f.first) + ", " + literal_fn(f.second) + "},\n";
+        out += "    }};\n";
+        out += "} // namespace config_ns::embedded_ns\n";
+
+        util_ns::write_file_atomic_fn(argv[2], out);
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "mfetch-embed: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}